@@ -5,12 +5,14 @@
 #include <avr/pgmspace.h>
 
 #include "laser-power.h"
+#include "latency.h"
 #include "low-voltage.h"
 #include "motors.h"
 #include "relays.h"
 #include "report.h"
 #include "safety.h"
 #include "scheduler.h"
+#include "timer.h"
 #include "variables.h"
 
 #if 0
@@ -74,25 +76,33 @@ void action_power(void)
 void action_enqueue_dwell(void)
 {
     // ANNOUNCE_ACTION;
+    uint32_t start = microsecond_time();
     enqueue_dwell();
+    record_latency(L_SCHEDULE, start);
 }
 
 void action_enqueue_move(void)
 {
     ANNOUNCE_ACTION;
+    uint32_t start = microsecond_time();
     enqueue_move();
+    record_latency(L_SCHEDULE, start);
 }
 
 void action_enqueue_cut(void)
 {
     ANNOUNCE_ACTION;
+    uint32_t start = microsecond_time();
     enqueue_cut();
+    record_latency(L_SCHEDULE, start);
 }
 
 void action_enqueue_home(void)
 {
     ANNOUNCE_ACTION;
+    uint32_t start = microsecond_time();
     enqueue_home();
+    record_latency(L_SCHEDULE, start);
 }
 
 void action_enable_low_voltage(void)
@@ -11,12 +11,13 @@
 DEFINE_ATOM_NAME(A_STOP);
 DEFINE_ATOM_NAME(A_DIR_POSITIVE);
 DEFINE_ATOM_NAME(A_DIR_NEGATIVE);
-DEFINE_ATOM_NAME(A_LOOP_UNTIL_MIN);
-DEFINE_ATOM_NAME(A_LOOP_WHILE_MIN);
-DEFINE_ATOM_NAME(A_LOOP_UNTIL_MAX);
-DEFINE_ATOM_NAME(A_LOOP_WHILE_MAX);
 DEFINE_ATOM_NAME(A_ENABLE_STEP);
 DEFINE_ATOM_NAME(A_DISABLE_STEP);
+DEFINE_ATOM_NAME(A_REWIND_IF_MIN);
+DEFINE_ATOM_NAME(A_REWIND_UNLESS_MIN);
+DEFINE_ATOM_NAME(A_REWIND_IF_MAX);
+DEFINE_ATOM_NAME(A_REWIND_UNLESS_MAX);
+DEFINE_ATOM_NAME(A_ZERO_POSITION);
 DEFINE_ATOM_NAME(A_LASERS_OFF);
 DEFINE_ATOM_NAME(A_MAIN_LASER_OFF);
 DEFINE_ATOM_NAME(A_MAIN_LASER_ON);
@@ -26,18 +27,20 @@ DEFINE_ATOM_NAME(A_VISIBLE_LASER_OFF);
 DEFINE_ATOM_NAME(A_VISIBLE_LASER_ON);
 DEFINE_ATOM_NAME(A_VISIBLE_LASER_START);
 DEFINE_ATOM_NAME(A_VISIBLE_LASER_STOP);
+DEFINE_ATOM_NAME(A_SEGMENT_END);
 DEFINE_ATOM_NAME(INVALID_ATOM);
 
 static const char *const atom_names[ATOM_COUNT + 1] PROGMEM = {
     A_STOP_name,
     A_DIR_POSITIVE_name,
     A_DIR_NEGATIVE_name,
-    A_LOOP_UNTIL_MIN_name,
-    A_LOOP_WHILE_MIN_name,
-    A_LOOP_UNTIL_MAX_name,
-    A_LOOP_WHILE_MAX_name,
     A_ENABLE_STEP_name,
     A_DISABLE_STEP_name,
+    A_REWIND_IF_MIN_name,
+    A_REWIND_UNLESS_MIN_name,
+    A_REWIND_IF_MAX_name,
+    A_REWIND_UNLESS_MAX_name,
+    A_ZERO_POSITION_name,
     A_LASERS_OFF_name,
     A_MAIN_LASER_OFF_name,
     A_MAIN_LASER_ON_name,
@@ -47,6 +50,7 @@ static const char *const atom_names[ATOM_COUNT + 1] PROGMEM = {
     A_VISIBLE_LASER_ON_name,
     A_VISIBLE_LASER_START_name,
     A_VISIBLE_LASER_STOP_name,
+    A_SEGMENT_END_name,
     INVALID_ATOM_name,
 };
 
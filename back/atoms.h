@@ -22,6 +22,7 @@ typedef enum atom {
     A_REWIND_UNLESS_MIN,
     A_REWIND_IF_MAX,
     A_REWIND_UNLESS_MAX,
+    A_ZERO_POSITION,
 
     // Atoms for lasers
     A_LASERS_OFF,
@@ -36,6 +37,9 @@ typedef enum atom {
     A_VISIBLE_LASER_START,
     A_VISIBLE_LASER_STOP,
 
+    // Atom for the laser queue only
+    A_SEGMENT_END,              // followed by the segment number
+
     ATOM_COUNT,
     INVALID_ATOM = ATOM_COUNT
 
@@ -11,6 +11,7 @@
 #include "limit-switches.h"
 #include "motors.h"
 #include "queues.h"
+#include "timer.h"
 
 typedef enum queue_mask {
     qm_x   = 1 << 0,
@@ -21,28 +22,53 @@ typedef enum queue_mask {
 } queue_mask;
 
 static volatile queue_mask running_queues;
+static          int32_t    x_position, y_position, z_position;
+static          uint16_t   completed_segment = 0xFFFF;
+
+// Feed hold.
+//
+// The four timers run in lock step, so a hold must slow them all
+// together.  It switches all four clocks at once, from clk/1 to clk/8
+// to clk/64, one stage every HOLD_STAGE_MS, then stops them.  The
+// queues and the counts are untouched, so a resume runs the stages
+// in reverse and every move continues where it left off.
+//
+// The lasers are off from the start of a hold until full speed
+// returns.  Meanwhile the engine remembers the last laser atom it
+// reached and applies it on resume.
+
+#define HOLD_STAGE_MS     20
+#define HOLD_STAGE_COUNT   4
+#define HOLD_FULL_SPEED    0
+#define HOLD_STOPPED      (HOLD_STAGE_COUNT - 1)
+#define CLOCK_SELECT_MASK 0x07
+
+// Clock select bits, CS[2:0], for each stage.  They are in the same
+// place in all four timers' TCCRnB.
+static const uint8_t stage_clock[HOLD_STAGE_COUNT] = {
+    0x01,                       // clk/1
+    0x02,                       // clk/8
+    0x03,                       // clk/64
+    0x00,                       // stopped
+};
+
+static          timeout    hold_timeout;
+static volatile uint8_t    hold_stage  = HOLD_FULL_SPEED;
+static volatile uint8_t    hold_target = HOLD_FULL_SPEED;
+static volatile bool       lasers_held;
+static volatile atom       laser_atom  = A_LASERS_OFF;
 
 void init_engine(void)
 {
 }
 
-static inline void start_timers(void)
+static inline void write_tccrbs(uint8_t xrb,
+                                uint8_t yrb,
+                                uint8_t zrb,
+                                uint8_t prb)
 {
-    // In the asm instruction sequence below, the counters are
-    // started exactly two CPU cycles apart.  So we preload
-    // the overflow value with values exactly two counts
-    // apart, and then the counters will all overflow on the
-    // exact same clock tick, and the timers will be in sync.
-
-    pre_start_x_timer(F_CPU / 1000);
-    pre_start_y_timer(F_CPU / 1000 - 2);
-    pre_start_z_timer(F_CPU / 1000 - 4);
-    pre_start_pulse_timer(F_CPU / 1000 - 6);
-
-    uint8_t xrb = x_timer_starting_tccrb();
-    uint8_t yrb = y_timer_starting_tccrb();
-    uint8_t zrb = z_timer_starting_tccrb();
-    uint8_t prb = pulse_timer_starting_tccrb();
+    // In the asm instruction sequence below, the registers are
+    // written exactly two CPU cycles apart.
 
     __asm__ volatile (
         "sts %0, %1\n\t"
@@ -60,6 +86,44 @@ static inline void start_timers(void)
     );
 }
 
+static inline uint8_t staged_tccrb(uint8_t starting_tccrb)
+{
+    return (starting_tccrb & ~CLOCK_SELECT_MASK) | stage_clock[hold_stage];
+}
+
+static inline void start_timers(void)
+{
+    // write_tccrbs() starts the counters exactly two CPU cycles
+    // apart.  So we preload the overflow value with values exactly
+    // two counts apart, and then the counters will all overflow on
+    // the exact same clock tick, and the timers will be in sync.
+    // During a hold, they start at the current stage's speed, and
+    // are in sync to within a count.
+
+    pre_start_x_timer(F_CPU / 1000);
+    pre_start_y_timer(F_CPU / 1000 - 2);
+    pre_start_z_timer(F_CPU / 1000 - 4);
+    pre_start_pulse_timer(F_CPU / 1000 - 6);
+
+    write_tccrbs(staged_tccrb(x_timer_starting_tccrb()),
+                 staged_tccrb(y_timer_starting_tccrb()),
+                 staged_tccrb(z_timer_starting_tccrb()),
+                 staged_tccrb(pulse_timer_starting_tccrb()));
+}
+
+// Switch the running timers to the current stage's clock.  Stopped
+// timers stay stopped.  The switch can't be exact to the cycle, since
+// the prescaler may tick while the registers are written, but all
+// four counters stay within a count or two of each other.
+static inline void set_stage_clocks_NONATOMIC(void)
+{
+    queue_mask rq = running_queues;
+    write_tccrbs(rq & qm_x ? staged_tccrb(x_timer_starting_tccrb())     : 0,
+                 rq & qm_y ? staged_tccrb(y_timer_starting_tccrb())     : 0,
+                 rq & qm_z ? staged_tccrb(z_timer_starting_tccrb())     : 0,
+                 rq & qm_p ? staged_tccrb(pulse_timer_starting_tccrb()) : 0);
+}
+
 void start_engine(void)
 {
     uint8_t rq;
@@ -89,6 +153,12 @@ void stop_engine_immediately(void)
         stop_z_timer_NONATOMIC();
         stop_pulse_timer_NONATOMIC();
         running_queues = 0;
+
+        // Stopping cancels any hold.
+        dequeue_timeout(&hold_timeout);
+        hold_stage = hold_target = HOLD_FULL_SPEED;
+        lasers_held = false;
+        laser_atom = A_LASERS_OFF;
     }
 }
 
@@ -98,8 +168,146 @@ void await_engine_stopped(void)
         continue;
 }
 
+void get_step_position(step_position *pos)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        pos->sp_x = x_position;
+        pos->sp_y = y_position;
+        pos->sp_z = z_position;
+    }
+}
+
+static inline void apply_laser_atom_NONATOMIC(atom a)
+{
+    switch (a) {
+
+    case A_LASERS_OFF:
+        safe_set_lasers_off();
+        break;
+
+    case A_MAIN_LASER_OFF:
+        safe_set_main_laser_off();
+        break;
+
+    case A_MAIN_LASER_ON:
+        safe_set_main_laser_on();
+        break;
+
+    case A_MAIN_LASER_START:
+        safe_set_main_laser_start_on_timer();
+        break;
+
+    case A_MAIN_LASER_STOP:
+        safe_set_main_laser_stop_on_timer();
+        break;
+
+    case A_VISIBLE_LASER_OFF:
+        safe_set_visible_laser_off();
+        break;
+
+    case A_VISIBLE_LASER_ON:
+        safe_set_visible_laser_on();
+        break;
+
+    case A_VISIBLE_LASER_START:
+        safe_set_visible_laser_start_on_timer();
+        break;
+
+    case A_VISIBLE_LASER_STOP:
+        safe_set_visible_laser_stop_on_timer();
+        break;
+
+    default:
+        fw_assert(false);
+    }
+}
+
+// Move one stage toward the target.  Called from the hold timeout,
+// and directly when a hold or resume starts.
+static void step_hold_NONATOMIC(void)
+{
+    uint8_t stage = hold_stage;
+    if (stage < hold_target)
+        stage++;
+    else if (stage > hold_target)
+        stage--;
+    hold_stage = stage;
+    set_stage_clocks_NONATOMIC();
+    if (stage == HOLD_FULL_SPEED && lasers_held) {
+        lasers_held = false;
+        apply_laser_atom_NONATOMIC(laser_atom);
+    }
+    if (stage == hold_target)
+        dequeue_timeout(&hold_timeout);
+}
+
+static void hold_timeout_func(void)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        step_hold_NONATOMIC();
+    }
+}
+
+static void start_hold_NONATOMIC(uint8_t target)
+{
+    if (hold_target == target)
+        return;
+    hold_target = target;
+    step_hold_NONATOMIC();
+    if (hold_stage != target) {
+        hold_timeout.to_interval = HOLD_STAGE_MS;
+        hold_timeout.to_func = hold_timeout_func;
+        enqueue_timeout(&hold_timeout,
+                        millisecond_time_NONATOMIC() + HOLD_STAGE_MS);
+    }
+}
+
+void feed_hold_NONATOMIC(void)
+{
+    lasers_held = true;
+    safe_set_lasers_off();
+    start_hold_NONATOMIC(HOLD_STOPPED);
+}
+
+void feed_resume_NONATOMIC(void)
+{
+    start_hold_NONATOMIC(HOLD_FULL_SPEED);
+}
+
+feed_hold_state get_feed_hold_state(void)
+{
+    uint8_t stage, target;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        stage = hold_stage;
+        target = hold_target;
+    }
+    if (stage == target)
+        return stage == HOLD_STOPPED ? FH_HELD : FH_RUNNING;
+    return target == HOLD_STOPPED ? FH_SLOWING : FH_RESUMING;
+}
+
+uint16_t last_completed_segment(void)
+{
+    uint16_t seg;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        seg = completed_segment;
+    }
+    return seg;
+}
+
+// The step pulse comes at the start of each timer period, before the
+// overflow interrupt can change the step enable or direction.  So on
+// entry, the interrupt counts the step just sent using the settings
+// already in force.
+#define COUNT_STEP(a)                                                   \
+    do {                                                                \
+        if (a##_step_pulse_is_enabled())                                \
+            a##_position += a##_direction_is_positive() ? +1 : -1;      \
+    } while (0)
+
 ISR(X_MOTOR_STEP_TIMER_OVF_vect)
 {
+    COUNT_STEP(x);
     while (true) {
         uint16_t a = dequeue_atom_X_NONATOMIC();
         if (a < ATOM_MAX) {
@@ -126,6 +334,10 @@ ISR(X_MOTOR_STEP_TIMER_OVF_vect)
                 safe_disable_x_step();
                 break;
 
+            case A_ZERO_POSITION:
+                x_position = 0;
+                break;
+
 #ifdef X_MIN_SWITCH
             case A_REWIND_IF_MIN:
                 a = dequeue_atom_X_NONATOMIC();
@@ -167,6 +379,7 @@ ISR(X_MOTOR_STEP_TIMER_OVF_vect)
 
 ISR(Y_MOTOR_STEP_TIMER_OVF_vect)
 {
+    COUNT_STEP(y);
     while (true) {
         uint16_t a = dequeue_atom_Y_NONATOMIC();
         if (a < ATOM_MAX) {
@@ -221,6 +434,10 @@ ISR(Y_MOTOR_STEP_TIMER_OVF_vect)
                 safe_disable_y_step();
                 break;
 
+            case A_ZERO_POSITION:
+                y_position = 0;
+                break;
+
             default:
                 fprintf_P(stderr, PSTR("a = %u\n"), a);
                 fw_assert(false);
@@ -234,6 +451,7 @@ ISR(Y_MOTOR_STEP_TIMER_OVF_vect)
 
 ISR(Z_MOTOR_STEP_TIMER_OVF_vect)
 {
+    COUNT_STEP(z);
     while (true) {
         uint16_t a = dequeue_atom_Z_NONATOMIC();
         if (a < ATOM_MAX) {
@@ -288,6 +506,10 @@ ISR(Z_MOTOR_STEP_TIMER_OVF_vect)
                 safe_disable_z_step();
                 break;
 
+            case A_ZERO_POSITION:
+                z_position = 0;
+                break;
+
             default:
                 fprintf_P(stderr, PSTR("a = %u\n"), a);
                 fw_assert(false);
@@ -308,44 +530,27 @@ ISR(LASER_PULSE_TIMER_OVF_vect)
 
             case A_STOP:
                 safe_set_lasers_off();
+                laser_atom = A_LASERS_OFF;
                 stop_pulse_timer_NONATOMIC();
                 running_queues &= ~qm_p;
                 return;
 
             case A_LASERS_OFF:
-                safe_set_lasers_off();
-                break;
-
             case A_MAIN_LASER_OFF:
-                safe_set_main_laser_off();
-                break;
-
             case A_MAIN_LASER_ON:
-                safe_set_main_laser_on();
-                break;
-
             case A_MAIN_LASER_START:
-                safe_set_main_laser_start_on_timer();
-                break;
-
             case A_MAIN_LASER_STOP:
-                safe_set_main_laser_stop_on_timer();
-                break;
-
             case A_VISIBLE_LASER_OFF:
-                safe_set_visible_laser_off();
-                break;
-
             case A_VISIBLE_LASER_ON:
-                safe_set_visible_laser_on();
-                break;
-
             case A_VISIBLE_LASER_START:
-                safe_set_visible_laser_start_on_timer();
+            case A_VISIBLE_LASER_STOP:
+                laser_atom = a;
+                if (!lasers_held)
+                    apply_laser_atom_NONATOMIC(a);
                 break;
 
-            case A_VISIBLE_LASER_STOP:
-                safe_set_visible_laser_stop_on_timer();
+            case A_SEGMENT_END:
+                completed_segment = dequeue_atom_P_NONATOMIC();
                 break;
 
             default:
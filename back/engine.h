@@ -1,6 +1,29 @@
 #ifndef ENGINE_included
 #define ENGINE_included
 
+#include <stdint.h>
+
+// A feed hold slows the engine to a stop without disturbing the
+// queues, and a resume brings it back to full speed.  The serial
+// receive interrupt calls these when the host sends the control
+// bytes.
+
+typedef enum feed_hold_state {
+    FH_RUNNING  = 'r',
+    FH_SLOWING  = 's',
+    FH_HELD     = 'h',
+    FH_RESUMING = 'g',
+} feed_hold_state;
+
+// The engine counts the step pulses it sends each motor, so it knows
+// each axis's position in microsteps.  Homing sets the position to 0.
+
+typedef struct step_position {
+    int32_t sp_x;
+    int32_t sp_y;
+    int32_t sp_z;
+} step_position;
+
 extern void init_engine(void);  // Why not?
 
 extern void start_engine(void);
@@ -8,4 +31,15 @@ extern void start_engine(void);
 extern void stop_engine_immediately(void);
 extern void await_engine_stopped(void);
 
+extern void get_step_position(step_position *);
+
+extern void            feed_hold_NONATOMIC   (void);
+extern void            feed_resume_NONATOMIC (void);
+extern feed_hold_state get_feed_hold_state   (void);
+
+// Each enqueued segment is numbered (variable sn).  The engine records
+// the number of the last segment it has finished.  It starts at
+// 0xFFFF, "none".
+extern uint16_t last_completed_segment(void);
+
 #endif /* !ENGINE_included */
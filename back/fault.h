@@ -4,26 +4,15 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "config/proto-defs.h"
+
 #include "fw_assert.h"
 
 // Interface
 
-#define FAULT_NAME_SIZE 3
-
+// The faults are defined in config/protocol.py.
 typedef enum fault_index {
-    F_ES =  0,                  // Emergency Stop
-    F_LO =  1,                  // Lid Open
-    F_LC =  2,                  // Lid Closed
-    F_WF =  3,                  // Water Flow
-    F_WT =  4,                  // Water Temperature
-    F_LS =  5,                  // Limit Switch Stuck
-    F_SF =  6,                  // Serial Frame Error
-    F_SO =  7,                  // Serial Overrun
-    F_SP =  8,                  // Serial Parity Error
-    F_SL =  9,                  // Software Lexical Error
-    F_SS = 10,                  // Software Syntax Error
-    F_SU = 11,                  // Software Underflow
-    F_SI = 12,                  // Software Missed Interrupt
+    FAULT_INDEX_ENUMERATORS
     FAULT_COUNT
 } fault_index;
 
@@ -1,6 +1,7 @@
 #include "i2c.h"
 
 #include <avr/interrupt.h>
+#include <util/atomic.h>
 #include <util/twi.h>
 
 #include "config/pin-defs.h"
@@ -9,7 +10,12 @@
 #include "pin-io.h"
 
 #define I2C_BIT_RATE 100000
-#define I2C_MAX 3
+#define I2C_RETRIES  3          // restarts after lost arbitration
+
+#if I2C_QUEUE_SIZE & (I2C_QUEUE_SIZE - 1)
+#error "I2C_QUEUE_SIZE must be a power of two"
+#endif
+#define QUEUE_MASK (I2C_QUEUE_SIZE - 1)
 
 typedef enum i2c_state {
     IS_UNINIT,
@@ -17,25 +23,47 @@ typedef enum i2c_state {
     IS_MTX_BUSY,
 } i2c_state;
 
-static i2c_state state = IS_UNINIT;
+typedef struct i2c_transaction {
+    uint8_t        it_size;     // including address byte
+    i2cm_callback *it_callback;
+    uint8_t        it_buf[I2C_MAX + 1];
+} i2c_transaction;
+
+static volatile i2c_state state = IS_UNINIT;
 
-static uint8_t  *tx_data;
-static uint8_t   tx_count;
-static uint8_t   tx_status;
-static uint8_t   buf[I2C_MAX + 1];
+static i2c_transaction   queue[I2C_QUEUE_SIZE];
+static uint8_t           q_head;        // transaction on the bus
+static uint8_t           q_tail;        // next free slot
+static volatile uint8_t  q_count;
 
+static uint8_t           tx_pos;
+static uint8_t           tx_retries;
+static volatile uint8_t  tx_status;
 
-#define OR3(a,b,c)     (_BV(a) | _BV(b) | _BV(c))
-#define OR4(a,b,c,d)   (_BV(a) | _BV(b) | _BV(c) | _BV(d))
-#define OR5(a,b,c,d,e) (_BV(a) | _BV(b) | _BV(c) | _BV(d) | _BV(e))
+
+#define OR3(a,b,c)       (_BV(a) | _BV(b) | _BV(c))
+#define OR4(a,b,c,d)     (_BV(a) | _BV(b) | _BV(c) | _BV(d))
+#define OR5(a,b,c,d,e)   (_BV(a) | _BV(b) | _BV(c) | _BV(d) | _BV(e))
+#define OR6(a,b,c,d,e,f) (_BV(a) | _BV(b) | _BV(c) | _BV(d) | _BV(e) | _BV(f))
 
 
 // Constants for TWCR.
-#define TWC_INIT  (OR3(       TWEA,               TWEN, TWIE))
-#define TWC_START (OR5(TWINT, TWEA, TWSTA,        TWEN, TWIE))
-#define TWC_CONT  (OR4(TWINT, TWEA,               TWEN, TWIE))
-#define TWC_STOP  (OR5(TWINT, TWEA,        TWSTO, TWEN, TWIE))
-#define TWC_ABORT (OR4(TWINT, TWEA,               TWEN, TWIE))
+#define TWC_INIT       (OR3(       TWEA,                      TWEN, TWIE))
+#define TWC_START      (OR5(TWINT, TWEA, TWSTA,               TWEN, TWIE))
+#define TWC_CONT       (OR4(TWINT, TWEA,                      TWEN, TWIE))
+#define TWC_STOP       (OR5(TWINT, TWEA,        TWSTO,        TWEN, TWIE))
+#define TWC_STOP_START (OR6(TWINT, TWEA, TWSTA, TWSTO,        TWEN, TWIE))
+
+// Start the transaction at the head of the queue.  If the previous
+// transaction's STOP is still in progress, keep TWSTO set so the
+// hardware sends the START after it.
+static inline void start_transaction_NONATOMIC(void)
+{
+    state = IS_MTX_BUSY;
+    tx_pos = 0;
+    tx_retries = 0;
+    TWCR = TWC_START | (TWCR & _BV(TWSTO));
+}
 
 void init_i2c(void)
 {
@@ -48,57 +76,91 @@ void init_i2c(void)
     TWBR = (F_CPU / I2C_BIT_RATE - 16) / 2;
     TWCR = TWC_INIT;
     state = IS_IDLE;
+    if (q_count)
+        start_transaction_NONATOMIC();
 }
 
-void i2cm_transmit(uint8_t slave_addr, uint8_t *data, uint8_t  size)
+bool i2cm_transmit(uint8_t        slave_addr,
+                   const uint8_t *data,
+                   uint8_t        size,
+                   i2cm_callback *callback)
 {
     fw_assert(size <= I2C_MAX);
 
-    (void)i2cm_status();    // wait for previous transaction to finish
-    buf[0] = slave_addr << 1 | TW_WRITE;
-    for (uint8_t i = 0; i < size; i++)
-        buf[i + 1] = data[i];
-    tx_data = buf;
-    tx_count = size + 1;
-    TWCR = TWC_START;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (q_count == I2C_QUEUE_SIZE)
+            return false;
+        i2c_transaction *tp = &queue[q_tail];
+        tp->it_buf[0] = slave_addr << 1 | TW_WRITE;
+        for (uint8_t i = 0; i < size; i++)
+            tp->it_buf[i + 1] = data[i];
+        tp->it_size = size + 1;
+        tp->it_callback = callback;
+        q_tail = (q_tail + 1) & QUEUE_MASK;
+        if (q_count++ == 0 && state == IS_IDLE)
+            start_transaction_NONATOMIC();
+    }
+    return true;
 }
 
-uint8_t i2cm_status (void)
+uint8_t i2cm_status(void)
 {
-    while (state != IS_IDLE)
-        continue;
-    loop_until_bit_is_clear(TWCR, TWSTO);
     return tx_status;
 }
 
+// Send STOP (which also recovers from a bus error), retire the head
+// transaction, and start the next one if there is one.
+static void finish_transaction(uint8_t status)
+{
+    i2cm_callback *callback = queue[q_head].it_callback;
+    q_head = (q_head + 1) & QUEUE_MASK;
+    tx_status = status;
+    if (--q_count) {
+        tx_pos = 0;
+        tx_retries = 0;
+        TWCR = TWC_STOP_START;
+    } else {
+        TWCR = TWC_STOP;
+        state = IS_IDLE;
+    }
+    if (callback)
+        (*callback)(status);
+}
+
 ISR(TWI_vect)
 {
     uint8_t tw_sts = TW_STATUS;
+    i2c_transaction *tp = &queue[q_head];
     switch (tw_sts) {
 
     case TW_START:
+    case TW_REP_START:
+        tx_pos = 0;
+        // fall through
     case TW_MT_SLA_ACK:
     case TW_MT_DATA_ACK:
-        if (tx_count) {
+        if (tx_pos < tp->it_size) {
             // Transmit next byte.
-            TWDR = *tx_data;
+            TWDR = tp->it_buf[tx_pos++];
             TWCR = TWC_CONT;
-            tx_data++;
-            tx_count--;
         } else {
-            // Done.  Transmit STOP.
-            TWCR = TWC_STOP;
-            tx_status = 0;
-            state = IS_IDLE;
+            // Done.
+            finish_transaction(0);
         }
         break;
 
+    case TW_MT_ARB_LOST:
+        // Another master has the bus.  START again when it is free.
+        if (++tx_retries <= I2C_RETRIES) {
+            TWCR = TWC_START;
+            break;
+        }
+        // fall through
     case TW_MT_SLA_NACK:
     case TW_MT_DATA_NACK:
-    case TW_MT_ARB_LOST:
+    case TW_BUS_ERROR:
     default:
-        tx_status = tw_sts;
-        TWCR = TWC_ABORT;
+        finish_transaction(tw_sts);
         break;
     }
 }
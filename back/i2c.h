@@ -1,15 +1,36 @@
 #ifndef I2C_included
 #define I2C_included
 
+#include <stdbool.h>
 #include <stdint.h>
 
+// The i2c master driver is fully asynchronous.  Transactions are
+// queued in a small ring and run, one after another, from the TWI
+// interrupt.  Base-level code never waits for the bus.
+//
+// When a transaction finishes, successfully or not, its completion
+// callback (if any) is called from the interrupt handler with the
+// final TWI status: 0 for success, else the TW_* status code that
+// ended the transaction.  The callback may queue another transaction.
+
+#define I2C_MAX        8        // max bytes in one transaction
+#define I2C_QUEUE_SIZE 4        // max transactions pending
+
+typedef void i2cm_callback(uint8_t status);
+
 extern void init_i2c(void);
 
 // i2cm - i2c master
-extern void    i2cm_transmit (uint8_t slave_addr, uint8_t *data, uint8_t size);
-extern uint8_t i2cm_status   (void);
+
+// Queue a transaction.  Returns false if the queue is full.
+// The data are copied; the caller's buffer may be reused at once.
+extern bool    i2cm_transmit (uint8_t        slave_addr,
+                              const uint8_t *data,
+                              uint8_t        size,
+                              i2cm_callback *callback);
+extern uint8_t i2cm_status   (void); // status of last completed transaction
 
 // i2cs - i2c slave
 // not needed
 
-#endif /* !I2C_include */
+#endif /* !I2C_included */
@@ -1,12 +1,60 @@
 #include "laser-power.h"
 
-//#include <avr/interrupt.h>
+#include <stdbool.h>
 
+#include <util/atomic.h>
+
+#include "fault.h"
 #include "i2c.h"
 
 #define MCP4725_ADDR0         0x62
 #define MCP4725_CMD_WRITE_DAC 0x40
 
+#define MAX_SEND_RETRIES      3
+
+// The DAC is updated asynchronously.  While one update is on the
+// bus, newer levels overwrite wanted_level; the completion callback
+// then sends the latest one.  Intermediate levels are dropped.
+//
+// A failed write is retried a few times.  If the DAC still does not
+// answer, F_LP is raised and the level is resent on the next request.
+
+static volatile uint16_t wanted_level;
+static uint16_t          sent_level = ~0;
+static volatile bool     update_busy;
+static uint8_t           send_retries;
+
+static void send_level_NONATOMIC(void);
+
+static void level_sent(uint8_t status)
+{
+    update_busy = false;
+    if (status) {
+        sent_level = ~0;
+        if (++send_retries > MAX_SEND_RETRIES) {
+            send_retries = 0;
+            raise_fault(F_LP);
+            return;
+        }
+    } else {
+        send_retries = 0;
+        lower_fault(F_LP);
+    }
+    send_level_NONATOMIC();
+}
+
+static void send_level_NONATOMIC(void)
+{
+    uint16_t level = wanted_level;
+    if (update_busy || level == sent_level)
+        return;
+    uint8_t buf[3] = { MCP4725_CMD_WRITE_DAC, level >> 4, level << 4 };
+    if (i2cm_transmit(MCP4725_ADDR0, buf, sizeof buf, level_sent)) {
+        update_busy = true;
+        sent_level = level;
+    }
+}
+
 void init_laser_power(void)
 {
     set_laser_power(0);
@@ -14,7 +62,8 @@ void init_laser_power(void)
 
 void set_laser_power(uint16_t level)
 {
-    uint8_t buf[3] = { MCP4725_CMD_WRITE_DAC, level >> 4, level << 4 };
-    i2cm_transmit(MCP4725_ADDR0, buf, 3);
-    (void)i2cm_status();
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        wanted_level = level;
+        send_level_NONATOMIC();
+    }
 }
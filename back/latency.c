@@ -0,0 +1,39 @@
+#include "latency.h"
+
+#include <util/atomic.h>
+
+#include "fw_assert.h"
+#include "timer.h"
+
+#define LATENCY_MIN_SHIFT 3     // bucket 0 is 2**3 usec wide
+
+static l_histogram histograms[LATENCY_COUNT];
+
+static inline uint8_t bucket(uint32_t usec)
+{
+    uint8_t b = 0;
+    for (usec >>= LATENCY_MIN_SHIFT; usec; usec >>= 1)
+        if (++b == LATENCY_BUCKETS - 1)
+            break;
+    return b;
+}
+
+void record_latency(l_index index, uint32_t start_usec)
+{
+    fw_assert(index < LATENCY_COUNT);
+    uint32_t usec = microsecond_time() - start_usec;
+    uint16_t *cp = &histograms[index][bucket(usec)];
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (*cp != UINT16_MAX)
+            ++*cp;
+    }
+}
+
+void get_latency(l_index index, l_histogram *hp)
+{
+    fw_assert(index < LATENCY_COUNT);
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        for (uint8_t i = 0; i < LATENCY_BUCKETS; i++)
+            (*hp)[i] = histograms[index][i];
+    }
+}
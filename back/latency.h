@@ -0,0 +1,27 @@
+#ifndef LATENCY_included
+#define LATENCY_included
+
+#include <stdint.h>
+
+// Latency histograms.  Each histogram has LATENCY_BUCKETS buckets of
+// doubling width: bucket 0 counts intervals under 8 usec, bucket 1
+// under 16 usec, and so on.  The last bucket counts everything
+// longer.  Counts stick at their maximum instead of wrapping.
+
+#define LATENCY_BUCKETS 12
+
+typedef enum latency_index {
+    L_PARSE,                    // parse and execute one command line
+    L_SCHEDULE,                 // schedule one motion command
+    LATENCY_COUNT
+} latency_index, l_index;
+
+typedef uint16_t l_histogram[LATENCY_BUCKETS];
+
+// Record the interval from start_usec (from microsecond_time()) to now.
+extern void record_latency (l_index, uint32_t start_usec);
+
+// Copy a histogram out.
+extern void get_latency    (l_index, l_histogram *);
+
+#endif /* !LATENCY_included */
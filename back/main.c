@@ -10,6 +10,7 @@
 #include "lasers.h"
 #include "LEDs.h"
 #include "laser-power.h"
+#include "latency.h"
 #include "limit-switches.h"
 #include "low-voltage.h"
 #include "memory.h"
@@ -77,7 +78,9 @@ static void do_background_task(void)
             trigger_serial_faults(e);
             continue;
         }
+        uint32_t start = microsecond_time();
         parse_line();
+        record_latency(L_PARSE, start);
     }
 }
 
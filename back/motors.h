@@ -31,12 +31,15 @@ static inline void    set_z_step_interval             (uint16_t ticks);
 // Reporting
 static inline bool    x_step_is_enabled               (void);
 static inline bool    x_direction_is_positive         (void);
+static inline bool    x_step_pulse_is_enabled         (void);
 
 static inline bool    y_step_is_enabled               (void);
 static inline bool    y_direction_is_positive         (void);
+static inline bool    y_step_pulse_is_enabled         (void);
 
 static inline bool    z_step_is_enabled               (void);
 static inline bool    z_direction_is_positive         (void);
+static inline bool    z_step_pulse_is_enabled         (void);
 
 // These "safe" functions control the motors subject to the safety policy.
 static inline void    safe_enable_x_motor             (void);
@@ -103,6 +106,11 @@ static inline bool x_direction_is_positive(void)
     return REG_BIT_IS(X_MOTOR_DIRECTION_PIN, X_MOTOR_DIRECTION_POSITIVE);
 }
 
+static inline bool x_step_pulse_is_enabled(void)
+{
+    return X_MOTOR_STEP_TCCRA & _BV(X_MOTOR_STEP_COM1);
+}
+
 static inline void unsafe_enable_x_motor(void)
 {
     SET_REG_BIT(X_MOTOR_ENABLE_PORT, X_MOTOR_ENABLED);
@@ -224,6 +232,11 @@ static inline bool y_direction_is_positive(void)
     return REG_BIT_IS(Y_MOTOR_DIRECTION_PIN, Y_MOTOR_DIRECTION_POSITIVE);
 }
 
+static inline bool y_step_pulse_is_enabled(void)
+{
+    return Y_MOTOR_STEP_TCCRA & _BV(Y_MOTOR_STEP_COM1);
+}
+
 static inline void unsafe_enable_y_motor(void)
 {
     SET_REG_BIT(Y_MOTOR_ENABLE_PORT, Y_MOTOR_ENABLED);
@@ -322,6 +335,11 @@ static inline bool z_direction_is_positive(void)
     return REG_BIT_IS(Z_MOTOR_DIRECTION_PIN, Z_MOTOR_DIRECTION_POSITIVE);
 }
 
+static inline bool z_step_pulse_is_enabled(void)
+{
+    return Z_MOTOR_STEP_TCCRA & _BV(Z_MOTOR_STEP_COM1);
+}
+
 static inline void unsafe_enable_z_motor(void)
 {
     SET_REG_BIT(Z_MOTOR_ENABLE_PORT, Z_MOTOR_ENABLED);
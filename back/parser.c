@@ -2,147 +2,53 @@
 
 #include <stdint.h>
 #include <stdio.h>
-#include <string.h>
 
 #include <avr/pgmspace.h>
 
+#include "config/proto-defs.h"
+
 #include "actions.h"
 #include "fault.h"
 #include "fw_assert.h"
 #include "serial.h"
 #include "variables.h"
 
-// Commands
-// Da Dh Dl Dr Dw Dx Dy Dz
-// Ea Eh El Er Ew Ex Ey Ez
-// I
-// P
-// Qc Qd Qe Qh Qm
-// R
-// S
-// W
-
 #define CMD_NOT_FOUND 0xFF      // returned by lookup_command()
-#define CMD_NAME_SIZE    3      // max command name size, including NUL byte
 
-typedef char             command_name[CMD_NAME_SIZE];
 typedef void             command_function(void);
-typedef command_name     c_name;
 typedef command_function c_func;
 
-typedef struct command_descriptor {
-    PGM_P   cd_name;
-    c_func *cd_func;
-} command_descriptor, c_desc;
-
-#define DEFINE_COMMAND_NAME(cmd) \
-    static const char cmd##_name[] PROGMEM = #cmd
-
-DEFINE_COMMAND_NAME(Da);
-DEFINE_COMMAND_NAME(Dh);
-DEFINE_COMMAND_NAME(Dl);
-DEFINE_COMMAND_NAME(Dr);
-DEFINE_COMMAND_NAME(Dw);
-DEFINE_COMMAND_NAME(Dx);
-DEFINE_COMMAND_NAME(Dy);
-DEFINE_COMMAND_NAME(Dz);
-DEFINE_COMMAND_NAME(Ea);
-DEFINE_COMMAND_NAME(Eh);
-DEFINE_COMMAND_NAME(El);
-DEFINE_COMMAND_NAME(Er);
-DEFINE_COMMAND_NAME(Ew);
-DEFINE_COMMAND_NAME(Ex);
-DEFINE_COMMAND_NAME(Ey);
-DEFINE_COMMAND_NAME(Ez);
-DEFINE_COMMAND_NAME(I);
-DEFINE_COMMAND_NAME(P);
-DEFINE_COMMAND_NAME(Qc);
-DEFINE_COMMAND_NAME(Qd);
-DEFINE_COMMAND_NAME(Qe);
-DEFINE_COMMAND_NAME(Qh);
-DEFINE_COMMAND_NAME(Qm);
-DEFINE_COMMAND_NAME(R);
-DEFINE_COMMAND_NAME(S);
-DEFINE_COMMAND_NAME(W);
+// Commands are found by direct indexing.  The first character selects
+// a row, and the second character (or its absence) selects an entry
+// in that row.  The tables are generated from config/protocol.py.
 
-static const c_desc command_descriptors[] PROGMEM = {
-    { Da_name, action_disable_air_pump     },
-    { Dh_name, action_disable_high_voltage },
-    { Dl_name, action_disable_low_voltage  },
-    { Dr_name, action_disable_reporting    },
-    { Dw_name, action_disable_water_pump   },
-    { Dx_name, action_disable_X_motor      },
-    { Dy_name, action_disable_Y_motor      },
-    { Dz_name, action_disable_Z_motor      },
-    { Ea_name, action_enable_air_pump      },
-    { Eh_name, action_enable_high_voltage  },
-    { El_name, action_enable_low_voltage   },
-    { Er_name, action_enable_reporting     },
-    { Ew_name, action_enable_water_pump    },
-    { Ex_name, action_enable_X_motor       },
-    { Ey_name, action_enable_Y_motor       },
-    { Ez_name, action_enable_Z_motor       },
-    { I_name,  action_illuminate           },
-    { P_name,  action_power                },
-    { Qc_name, action_enqueue_cut          },
-    { Qd_name, action_enqueue_dwell        },
-    { Qe_name, action_enqueue_engrave      },
-    { Qh_name, action_enqueue_home         },
-    { Qm_name, action_enqueue_move         },
-    { R_name,  action_report_status        },
-    { S_name,  action_stop                 },
-    { W_name,  action_wait                 },
-};
+static const uint8_t command_rows[26] PROGMEM = COMMAND_ROWS_INIT;
 
-#define COMMAND_COUNT \
-    (sizeof command_descriptors / sizeof command_descriptors[0])
+static const uint8_t command_table[COMMAND_ROW_COUNT][COMMAND_COL_COUNT]
+    PROGMEM = COMMAND_TABLE_INIT;
 
-static void get_cmd_name(uint8_t i, c_name *out)
-{
-    fw_assert(i < COMMAND_COUNT);
-    PGM_P ptr = (PGM_P)pgm_read_word(&command_descriptors[i].cd_name);
-    strncpy_P(*out, ptr, sizeof *out);
-    (*out)[sizeof *out - 1] = '\0';
-}
+static c_func * const command_functions[COMMAND_COUNT]
+    PROGMEM = COMMAND_FUNCTIONS_INIT;
 
 static c_func *get_cmd_func(uint8_t i)
 {
     fw_assert(i < COMMAND_COUNT);
-    return (c_func *)pgm_read_word(&command_descriptors[i].cd_func);
+    return (c_func *)pgm_read_word(&command_functions[i]);
 }
 
 void init_parser(void)
 {
 #ifndef FW_NDEBUG
-    c_name prev_name, curr_name;
-    for (uint8_t i = 0; i < COMMAND_COUNT; i++) {
-        get_cmd_name(i, &curr_name);
-        if (i)
-            fw_assert(strcmp(prev_name, curr_name) < 0);
-        strncpy(prev_name, curr_name, sizeof prev_name);
-    }
+    for (uint8_t i = 0; i < sizeof command_rows; i++)
+        fw_assert(pgm_read_byte(&command_rows[i]) < COMMAND_ROW_COUNT);
+    for (uint8_t i = 0; i < COMMAND_ROW_COUNT; i++)
+        for (uint8_t j = 0; j < COMMAND_COL_COUNT; j++) {
+            uint8_t index = pgm_read_byte(&command_table[i][j]);
+            fw_assert(index < COMMAND_COUNT || index == CMD_NOT_FOUND);
+        }
 #endif
 }
 
-
-static uint8_t lookup_command(c_name name)
-{
-    uint8_t lo = 0, hi = COMMAND_COUNT;
-    while (lo < hi) {
-        uint8_t mid = (lo + hi) / 2;
-        c_name mid_name;
-        get_cmd_name(mid, &mid_name);
-        int c = strcmp(name, mid_name);
-        if (c == 0)
-            return mid;
-        if (c < 0)
-            hi = mid;
-        else
-            lo = mid + 1;
-    }
-    return CMD_NOT_FOUND;
-}
-
 static inline bool is_eol(uint8_t c)
 {
     return c == '\r' || c == '\n';
@@ -153,30 +59,53 @@ static inline bool is_digit(uint8_t c)
     return c >= '0' && c <= '9';
 }
 
+// c1 is the second character of the line.  If it is an end of line
+// character, the command has a one character name.
+
+static uint8_t lookup_command(uint8_t c0, uint8_t c1)
+{
+    uint8_t row = c0 - 'A';
+    if (row >= sizeof command_rows)
+        return CMD_NOT_FOUND;
+    uint8_t col;
+    if (is_eol(c1))
+        col = 0;
+    else {
+        col = c1 - ('a' - 1);
+        if (col == 0 || col >= COMMAND_COL_COUNT)
+            return CMD_NOT_FOUND;
+    }
+    row = pgm_read_byte(&command_rows[row]);
+    return pgm_read_byte(&command_table[row][col]);
+}
+
+// The line being parsed.  parse_line() is only called when a whole
+// line has been received, so every position up to and including the
+// line's EOL is valid.
+static rx_snap snapshot;
+
+static inline uint8_t line_char(uint8_t pos)
+{
+    return serial_rx_snapshot_char(&snapshot, pos);
+}
+
 #define PARSE_ERROR() (parse_error(__LINE__))
 
 static void parse_error(uint16_t line)
 {
     // Send uninformative message, consume current line and continue.
     printf_P(PSTR("Parse error %u at \""), line);
-    while (true) {
-        while (!serial_rx_has_chars())
-            continue;
-        uint8_t e = serial_rx_errors();
-        if (e)
-            fw_assert(0 && "XXX Write me !");
-        uint8_t c = serial_rx_peek_char(0);
-        serial_rx_consume(1);
-        if (is_eol(c))
-            break;
+    uint8_t pos = 0;
+    uint8_t c;
+    while (!is_eol((c = line_char(pos++))))
         putchar(c);
-    }
+    serial_rx_consume(pos);
     printf_P(PSTR("\"\n"));
 }
 
 static bool consume_line(uint8_t pos)
 {
-    uint8_t c = serial_rx_peek_char(pos);
+    uint8_t c = line_char(pos);
     if (!is_eol(c)) {
         PARSE_ERROR();
         return false;
@@ -187,14 +116,9 @@ static bool consume_line(uint8_t pos)
 
 static inline void parse_action(uint8_t c0)
 {
-    c_name name;
-    name[0] = c0;
-    uint8_t pos = 1;
-    uint8_t c1 = serial_rx_peek_char(1);
-    if (!is_eol(c1))
-        name[pos++] = c1;
-    name[pos] = '\0';
-    uint8_t index = lookup_command(name);
+    uint8_t c1 = line_char(1);
+    uint8_t pos = is_eol(c1) ? 1 : 2;
+    uint8_t index = lookup_command(c0, c1);
     if (index == CMD_NOT_FOUND) {
         PARSE_ERROR();
         return;
@@ -207,12 +131,12 @@ static inline void parse_action(uint8_t c0)
 
 static inline void parse_assignment(uint8_t c0)
 {
-    uint8_t c1 = serial_rx_peek_char(1);
+    uint8_t c1 = line_char(1);
     if (is_eol(c1)) {
         PARSE_ERROR();
         return;
     }
-    uint8_t c2 = serial_rx_peek_char(2);
+    uint8_t c2 = line_char(2);
     if (c2 != '=') {
         PARSE_ERROR();
         return;
@@ -230,7 +154,7 @@ static inline void parse_assignment(uint8_t c0)
 
     case VT_SIGNED:
         {
-            uint8_t c3 = serial_rx_peek_char(3);
+            uint8_t c3 = line_char(3);
             pos++;
             if (c3 == '-')
                 is_negative = true;
@@ -245,7 +169,7 @@ static inline void parse_assignment(uint8_t c0)
         {
             uint32_t n = 0;
             uint8_t c;
-            while (is_digit((c = serial_rx_peek_char(pos)))) {
+            while (is_digit((c = line_char(pos)))) {
                 n = 10 * n + (c - '0');
                 pos++;
             }
@@ -258,7 +182,7 @@ static inline void parse_assignment(uint8_t c0)
 
     case VT_ENUM:
         {
-            uint8_t c3 = serial_rx_peek_char(3);
+            uint8_t c3 = line_char(3);
             pos++;
             if (!variable_enum_is_OK(index, c3)) {
                 PARSE_ERROR();
@@ -279,7 +203,8 @@ static inline void parse_assignment(uint8_t c0)
 
 void parse_line(void)
 {
-    uint8_t c0 = serial_rx_peek_char(0);
+    serial_rx_take_snapshot(&snapshot);
+    uint8_t c0 = line_char(0);
     if (is_eol(c0)) {
         serial_rx_consume(1);
         return;
@@ -1,12 +1,15 @@
 #include "report.h"
 
-#include <inttypes.h>
 #include <stddef.h>
 #include <stdio.h>
 
 #include <avr/pgmspace.h>
 
+#include "config/proto-defs.h"
+
+#include "engine.h"
 #include "fault.h"
+#include "latency.h"
 #include "limit-switches.h"
 #include "low-voltage.h"
 #include "memory.h"
@@ -14,11 +17,31 @@
 #include "queues.h"
 #include "relays.h"
 #include "safety.h"
+#include "scheduler.h"
 #include "serial.h"
 #include "timer.h"
 #include "variables.h"
 #include "version.h"
 
+// Status reports are sent as one binary frame, which thruport decodes
+// back into the text lines kbmon and other receivers expect.  The
+// frame layout must match front/thruport/report_decoder.c.
+//
+// A frame is FRAME_START, the encoded payload, and FRAME_END.  The
+// payload is packed six bits per byte, least significant bits first,
+// each byte tagged 0x80.  So no frame byte is ASCII, and none looks
+// like a flow control character (0xF0 - 0xFF).
+//
+// The payload is a sequence number, a record for each enabled report,
+// and a checksum byte that brings the payload's sum to zero.  Each
+// record starts with its report's letter.  Multibyte numbers are
+// little-endian.
+
+#define FRAME_START  0xC0
+#define FRAME_END    0xC1
+#define FRAME_SIZE   250        // encoded, including start and end;
+                                // must fit in tx_buf
+
 typedef void report_func(void);
 
 typedef struct report_descriptor {
@@ -26,116 +49,204 @@ typedef struct report_descriptor {
     report_func   *rd_func;
 } report_descriptor, r_desc;
 
+#define VAR_SNAPSHOT_INTERVAL 16
+
 static          timeout report_timeout;
 static volatile bool    reporting_is_active;
+static          bool    full_report;
+static          uint8_t reports_until_snapshot;
+
+static struct report_frame {
+    uint8_t  rf_buf[FRAME_SIZE];
+    uint8_t  rf_size;
+    uint16_t rf_bits;           // bits not yet encoded
+    uint8_t  rf_nbits;
+    uint8_t  rf_sum;
+    uint8_t  rf_seq;
+} frame;
+
+static inline void frame_emit(uint8_t c)
+{
+    fw_assert(frame.rf_size < FRAME_SIZE);
+    frame.rf_buf[frame.rf_size++] = c;
+}
+
+static void frame_put_u8(uint8_t b)
+{
+    frame.rf_sum += b;
+    frame.rf_bits |= (uint16_t)b << frame.rf_nbits;
+    frame.rf_nbits += 8;
+    while (frame.rf_nbits >= 6) {
+        frame_emit(0x80 | (frame.rf_bits & 0x3F));
+        frame.rf_bits >>= 6;
+        frame.rf_nbits -= 6;
+    }
+}
+
+static void frame_put_u16(uint16_t w)
+{
+    frame_put_u8(w);
+    frame_put_u8(w >> 8);
+}
+
+static void frame_put_u32(uint32_t l)
+{
+    frame_put_u16(l);
+    frame_put_u16(l >> 16);
+}
+
+static void begin_frame(void)
+{
+    frame.rf_size = 0;
+    frame.rf_bits = 0;
+    frame.rf_nbits = 0;
+    frame.rf_sum = 0;
+    frame_emit(FRAME_START);
+    frame_put_u8(frame.rf_seq++);
+}
+
+static bool end_frame(void)
+{
+    frame_put_u8(-frame.rf_sum);
+    if (frame.rf_nbits)
+        frame_emit(0x80 | frame.rf_bits);
+    frame_emit(FRAME_END);
+    return serial_tx_put_bytes(frame.rf_buf, frame.rf_size);
+}
 
 #define DEFINE_UNIMPLEMENTED_REPORT(code, name)                         \
     static void report_##name(void)                                     \
     {                                                                   \
-        printf_P(PSTR(#code " (" #name ") report not implemented\n"));  \
+        frame_put_u8('?');                                              \
+        frame_put_u8(#code[0]);                                         \
     }
 
-static inline char yes_no(bool choice)
+static inline uint8_t bit_if(bool b, uint8_t bit)
+{
+    return b ? 1 << bit : 0;
+}
+
+// Axis positions in microsteps, from the engine's step counters.
+static void report_positions(void)
 {
-    return choice ? 'y' : 'n';
+    step_position pos;
+    get_step_position(&pos);
+    frame_put_u8('A');
+    frame_put_u32(pos.sp_x);
+    frame_put_u32(pos.sp_y);
+    frame_put_u32(pos.sp_z);
 }
 
 // This is now a misnomer.  It ought to be report_safety, but the S key
 // is taken by report_serial.
 static void report_e_stop(void)
 {
-    printf_P(PSTR("E o=%c b=%c l=%c v=%c m=%c\n"),
-             yes_no(lid_is_open()),
-             yes_no(stop_button_is_down()),
-             yes_no(main_laser_okay()),
-             yes_no(visible_laser_okay()),
-             yes_no(movement_okay()));
+    frame_put_u8('E');
+    frame_put_u8(bit_if(lid_is_open(),         0) |
+                 bit_if(stop_button_is_down(), 1) |
+                 bit_if(main_laser_okay(),     2) |
+                 bit_if(visible_laser_okay(),  3) |
+                 bit_if(movement_okay(),       4));
 }
 
 static void report_faults(void)
 {
-    putchar('F');
-    for (uint8_t i = 0; i < FAULT_COUNT; i++) {
-        if (fault_is_set(i)) {
-            putchar(' ');
-            f_name name;
-            get_fault_name(i, &name);
-            printf_P(PSTR("%s"), name);
-        }
-    }
-    putchar('\n');
+    uint16_t faults = 0;
+    for (uint8_t i = 0; i < FAULT_COUNT; i++)
+        if (fault_is_set(i))
+            faults |= 1 << i;
+    frame_put_u8('F');
+    frame_put_u16(faults);
 }
 
+// Two bytes: which switches are present, and which are reached.
+// Bits are x min, x max, y min, y max, z min, z max.
 static void report_limit_switches(void)
 {
+    uint8_t present = 0, reached = 0;
+
 #ifdef X_MIN_SWITCH
-    const char xmin = yes_no(x_min_reached());
-#else
-    const char xmin = '_';
+    present |= bit_if(true, 0);
+    reached |= bit_if(x_min_reached(), 0);
 #endif
 
 #ifdef X_MAX_SWITCH
-    const char xmax = yes_no(x_max_reached());
-#else
-    const char xmax = '_';
+    present |= bit_if(true, 1);
+    reached |= bit_if(x_max_reached(), 1);
 #endif
 
 #ifdef Y_MIN_SWITCH
-    const char ymin = yes_no(y_min_reached());
-#else
-    const char ymin = '_';
+    present |= bit_if(true, 2);
+    reached |= bit_if(y_min_reached(), 2);
 #endif
 
 #ifdef Y_MAX_SWITCH
-    const char ymax = yes_no(y_max_reached());
-#else
-    const char ymax = '_';
+    present |= bit_if(true, 3);
+    reached |= bit_if(y_max_reached(), 3);
 #endif
 
 #ifdef Z_MIN_SWITCH
-    const char zmin = yes_no(z_min_reached());
-#else
-    const char zmin = '_';
+    present |= bit_if(true, 4);
+    reached |= bit_if(z_min_reached(), 4);
 #endif
 
 #ifdef Z_MAX_SWITCH
-    const char zmax = yes_no(z_max_reached());
-#else
-    const char zmax = '_';
+    present |= bit_if(true, 5);
+    reached |= bit_if(z_max_reached(), 5);
 #endif
 
-    printf_P(PSTR("L x=%c%c y=%c%c z=%c%c\n"),
-           xmin, xmax, ymin, ymax, zmin, zmax);
+    frame_put_u8('L');
+    frame_put_u8(present);
+    frame_put_u8(reached);
 }
 
+// Bits are enabled and positive direction for x, y, z.
 static void report_motors(void)
 {
-    char xe = x_step_is_enabled()       ? 'e' : 'd';
-    char xd = x_direction_is_positive() ? '+' : '-';
-    char ye = y_step_is_enabled()       ? 'e' : 'd';
-    char yd = y_direction_is_positive() ? '+' : '-';
-    char ze = z_step_is_enabled()       ? 'e' : 'd';
-    char zd = z_direction_is_positive() ? '+' : '-';
+    frame_put_u8('M');
+    frame_put_u8(bit_if(x_step_is_enabled(),       0) |
+                 bit_if(x_direction_is_positive(), 1) |
+                 bit_if(y_step_is_enabled(),       2) |
+                 bit_if(y_direction_is_positive(), 3) |
+                 bit_if(z_step_is_enabled(),       4) |
+                 bit_if(z_direction_is_positive(), 5));
+}
 
-    printf_P(PSTR("M x=%c%c y=%c%c z=%c%c\n"), xe, xd, ye, yd, ze, zd);
+// The next segment number and the last one finished.  Segment
+// numbers are 16 bits in the laser queue, so both are reported mod
+// 65536.
+static void report_segments(void)
+{
+    frame_put_u8('N');
+    frame_put_u16(get_unsigned_variable(V_SN));
+    frame_put_u16(last_completed_segment());
+}
+
+// The feed override percentage and the feed hold state.
+static void report_overrides(void)
+{
+    frame_put_u8('O');
+    frame_put_u8(get_feed_override());
+    frame_put_u8(get_feed_hold_state());
 }
 
 static void report_power(void)
 {
-    char low_voltage_enabled = yes_no(low_voltage_is_enabled());
-    char low_voltage_ready   = yes_no(low_voltage_is_ready());
-    char high_voltage        = yes_no(high_voltage_is_enabled());
-    char air                 = yes_no(air_pump_is_enabled());
-    char water               = yes_no(water_pump_is_enabled());
-    printf_P(PSTR("P le=%c lr=%c he=%c ae=%c we=%c\n"),
-           low_voltage_enabled, low_voltage_ready, high_voltage, air, water);
+    frame_put_u8('P');
+    frame_put_u8(bit_if(low_voltage_is_enabled(),  0) |
+                 bit_if(low_voltage_is_ready(),    1) |
+                 bit_if(high_voltage_is_enabled(), 2) |
+                 bit_if(air_pump_is_enabled(),     3) |
+                 bit_if(water_pump_is_enabled(),   4));
 }
 
 static void report_queues(void)
 {
-    printf_P(PSTR("Q x=%u y=%u z=%u p=%u\n"),
-             queue_length(&Xq), queue_length(&Yq),
-             queue_length(&Zq), queue_length(&Pq));
+    frame_put_u8('Q');
+    frame_put_u8(queue_length(&Xq));
+    frame_put_u8(queue_length(&Yq));
+    frame_put_u8(queue_length(&Zq));
+    frame_put_u8(queue_length(&Pq));
 }
 
 static void report_RAM(void)
@@ -143,66 +254,93 @@ static void report_RAM(void)
     // Technically, text is in program memory, not RAM.
     segment_sizes ss;
     get_memory_use(&ss);
-    printf_P(PSTR("R t=%u d=%u b=%u f=%u s=%u\n"),
-             ss.ss_text, ss.ss_data, ss.ss_bss, ss.ss_free, ss.ss_stack);
+    frame_put_u8('R');
+    frame_put_u16(ss.ss_text);
+    frame_put_u16(ss.ss_data);
+    frame_put_u16(ss.ss_bss);
+    frame_put_u16(ss.ss_free);
+    frame_put_u16(ss.ss_stack);
 }
 
 static void report_serial(void)
 {
-    uint8_t rc = serial_rx_char_count();
-    uint8_t rl = serial_rx_line_count();
-    uint8_t re = serial_rx_peek_errors();
-    uint8_t tc = serial_tx_char_count();
-    uint8_t te = serial_tx_peek_errors();
-    printf_P(PSTR("S rx c=%"PRId8" l=%"PRId8" e=%#"PRIx8", "
-                 "tx c=%"PRId8" e=%#"PRIx8"\n"),
-             rc, rl, re, tc, te);
+    frame_put_u8('S');
+    frame_put_u8(serial_rx_char_count());
+    frame_put_u8(serial_rx_line_count());
+    frame_put_u8(serial_rx_peek_errors());
+    frame_put_u8(serial_tx_char_count());
+    frame_put_u8(serial_tx_peek_errors());
+}
+
+// Histogram count, bucket count, then each histogram's key and counts.
+static void put_histogram(char key, l_index index)
+{
+    l_histogram h;
+    get_latency(index, &h);
+    frame_put_u8(key);
+    for (uint8_t i = 0; i < LATENCY_BUCKETS; i++)
+        frame_put_u16(h[i]);
+}
+
+static void report_timing(void)
+{
+    frame_put_u8('T');
+    frame_put_u8(LATENCY_COUNT);
+    frame_put_u8(LATENCY_BUCKETS);
+    put_histogram('p', L_PARSE);
+    put_histogram('s', L_SCHEDULE);
 }
 
+static void put_variable_value(v_index index)
+{
+    v_value value = get_variable(index);
+    if (get_variable_type(index) == VT_ENUM)
+        frame_put_u8(value.vv_enum);
+    else
+        frame_put_u32(value.vv_unsigned);
+}
+
+// Variables are reported in two forms.  A snapshot ('V') is the
+// variable count and every variable's value in index order: one byte
+// for an enum, four bytes for a number.  A delta ('v') is a count and
+// that many index/value pairs, for the variables changed since the
+// last report.  The decoder gets the names and types from
+// config/protocol.py too.
+//
+// A snapshot is sent every VAR_SNAPSHOT_INTERVAL reports, when
+// reporting is enabled, on request, after a frame is dropped, and
+// when more than half the variables have changed.
+
 static void report_variables(void)
 {
-    putchar('V');
-    for (v_index i = 0; i < VARIABLE_COUNT; i++) {
-        v_name name;
-        get_variable_name(i, &name);
-        v_type type = get_variable_type(i);
-        v_value value = get_variable(i);
-
-        printf_P(PSTR(" %s="), name);
-        switch (type) {
-        case VT_UNSIGNED:
-            printf_P(PSTR("%"PRIu32), value.vv_unsigned);
-            break;
-
-        case VT_SIGNED:
-            printf_P(PSTR("%+"PRId32), value.vv_signed);
-
-            break;
-        case VT_ENUM:
-            printf_P(PSTR("%c"), (int)value.vv_enum);
-            break;
-
-        default:
-            fw_assert(false);
+    bool changed[VARIABLE_COUNT];
+    uint8_t change_count = 0;
+    for (v_index i = 0; i < VARIABLE_COUNT; i++)
+        if ((changed[i] = take_variable_change(i)))
+            change_count++;
+
+    if (full_report || change_count > VARIABLE_COUNT / 2) {
+        frame_put_u8('V');
+        frame_put_u8(VARIABLE_COUNT);
+        for (v_index i = 0; i < VARIABLE_COUNT; i++)
+            put_variable_value(i);
+    } else if (change_count) {
+        frame_put_u8('v');
+        frame_put_u8(change_count);
+        for (v_index i = 0; i < VARIABLE_COUNT; i++) {
+            if (changed[i]) {
+                frame_put_u8(i);
+                put_variable_value(i);
+            }
         }
     }
-    putchar('\n');
 }
 
 DEFINE_UNIMPLEMENTED_REPORT(W, water);
 
-static const report_descriptor report_descriptors[] PROGMEM = {
-    { V_RE, report_e_stop         },
-    { V_RF, report_faults         },
-    { V_RL, report_limit_switches },
-    { V_RM, report_motors         },
-    { V_RP, report_power          },
-    { V_RQ, report_queues         },
-    { V_RR, report_RAM            },
-    { V_RS, report_serial         },
-    { V_RV, report_variables      },
-    { V_RW, report_water          },
-};
+// The reports are defined in config/protocol.py.
+static const report_descriptor report_descriptors[] PROGMEM =
+    REPORT_DESCRIPTORS_INIT;
 
 static const size_t report_descriptor_count =
     sizeof report_descriptors / sizeof report_descriptors[0];
@@ -212,12 +350,17 @@ void init_reporting(void)
     // ??? Anything to do?
 }
 
-void report_all(void)
+static void send_reports(bool full)
 {
     if (reporting_is_active)
         return;
     reporting_is_active = true;
     // report_version();
+    full_report = full || reports_until_snapshot == 0;
+    if (full_report)
+        reports_until_snapshot = VAR_SNAPSHOT_INTERVAL;
+    reports_until_snapshot--;
+    begin_frame();
     for (uint8_t i = 0; i < report_descriptor_count; i++) {
         const r_desc *rdp = report_descriptors + i;
         const v_index var = pgm_read_byte(&rdp->rd_var);
@@ -226,10 +369,21 @@ void report_all(void)
             (*func)();
         }
     }
-    puts("---\n");
+    if (!end_frame())
+        reports_until_snapshot = 0; // lost some deltas
     reporting_is_active = false;
 }
 
+static void report_periodic(void)
+{
+    send_reports(false);
+}
+
+void report_all(void)
+{
+    send_reports(true);
+}
+
 void report_version(void)
 {
     printf_P(PSTR("%S\n"), version);
@@ -240,7 +394,8 @@ extern void enable_reporting(void)
     uint32_t interval = get_unsigned_variable(V_RI);
     fw_assert(interval >= 10);
     report_timeout.to_interval = interval;
-    report_timeout.to_func = report_all;
+    report_timeout.to_func = report_periodic;
+    reports_until_snapshot = 0;
     enqueue_timeout(&report_timeout, millisecond_time() + interval);
 }
 
@@ -136,7 +136,8 @@ ISR(EMERGENCY_STOP_vect)
     // Disable interrupts, enqueue a timeout to re-enable them.
     EMERGENCY_STOP_PCMSK_reg &= ~_BV(EMERGENCY_STOP_PCINT_bit);
     LID_PCMSK_reg            &= ~_BV(LID_PCINT_bit);
-    enqueue_timeout(&safety_timeout, DEBOUNCE_MSEC);
+    enqueue_timeout(&safety_timeout,
+                    millisecond_time_NONATOMIC() + DEBOUNCE_MSEC);
 }
 
 static void observe(v_index var)
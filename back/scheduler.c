@@ -43,6 +43,8 @@ typedef int32_t int_fast24;
 typedef uint32_t uint_fast24;
 #endif
 
+static volatile uint8_t feed_override = 100;
+
 // timer_state is the abstract base class.  motor_timer_state and
 // laser_timer_state are concrete derived classes.
 
@@ -447,6 +449,48 @@ static inline void gen_laser_atoms(laser_timer_state *lp, queue *qp)
 }
 
 
+// segment end definitions
+
+// Each segment is numbered from variable sn.  After the segment's
+// last laser atom, the scheduler puts an A_SEGMENT_END atom and the
+// segment number in the laser queue.  The engine records the number
+// when it reaches them, i.e., when the segment is finished.  All four
+// queues run in step, so the laser queue alone marks the time.
+
+typedef struct segment_state {
+    bool     ss_pending;        // end not yet enqueued
+    uint16_t ss_number;
+} segment_state;
+
+static segment_state segment;
+
+static inline void init_segment_state(segment_state *sp)
+{
+    sp->ss_pending = false;
+}
+
+static inline void prep_segment_state(segment_state *sp)
+{
+    uint32_t sn = get_unsigned_variable(V_SN);
+    set_unsigned_variable(V_SN, sn + 1);
+    sp->ss_number  = sn;
+    sp->ss_pending = true;
+}
+
+static inline void gen_segment_end(segment_state           *sp,
+                                   const laser_timer_state *lp,
+                                   queue                   *qp)
+{
+    if (sp->ss_pending &&
+        laser_timer_loaded(lp) &&
+        queue_available(qp) >= 2) {
+        enqueue_atom(A_SEGMENT_END, qp);
+        enqueue_atom(sp->ss_number, qp);
+        sp->ss_pending = false;
+    }
+}
+
+
 // home_timer_state definitions
 
 // A home timer controls a motor during a homing action.
@@ -488,6 +532,7 @@ static inline void gen_laser_atoms(laser_timer_state *lp, queue *qp)
 //         A_REWIND_UNLESS_[limit]
 //         number of atoms to rewind: F - E
 //     label F:
+//         A_ZERO_POSITION
 //         A_STOP
 //
 // This entire sequence can be created at compile time.
@@ -516,6 +561,7 @@ static const uint16_t xy_home_seq[] PROGMEM = {
     A_DIR_NEGATIVE,             // Third stroke
     HOME_X_INTERVAL_3,
     A_REWIND_UNLESS_MIN, 3,     // back to INTERVAL_3
+    A_ZERO_POSITION,            // Home is position 0.
     A_STOP
 };
 
@@ -590,19 +636,40 @@ static inline uint_fast24 major_distance(int32_t xd, int32_t yd, int32_t zd)
     return md;
 }
 
+// Scale a move's time by the feed override.  The override is read as
+// each segment is prepared, so a change takes effect at the next
+// segment.  A faster feed never makes the major axis step faster
+// than MIN_IVL, unless the segment was already that fast.
+static inline uint32_t override_move_time(uint32_t mt, uint_fast24 md)
+{
+    uint8_t fo = feed_override;
+    if (fo == 100)
+        return mt;
+    uint32_t q = mt / fo;
+    uint32_t r = mt % fo;
+    if (q > (UINT32_MAX - 100) / 100)
+        return UINT32_MAX;
+    uint32_t t = q * 100 + r * 100 / fo;
+    if (t < mt && t / MIN_IVL < md)
+        t = mt / MIN_IVL < md ? mt : (uint32_t)md * MIN_IVL;
+    return t;
+}
+
 static inline bool all_timers_loaded(uint32_t mt)
 {
     return (motor_timer_loaded(&x_state) &&
             motor_timer_loaded(&y_state) &&
             motor_timer_loaded(&z_state) &&
-            laser_timer_loaded(&p_state));
+            laser_timer_loaded(&p_state) &&
+            !segment.ss_pending);
 }
 
 static inline bool home_timers_loaded(void)
 {
     return (home_timer_loaded(&x_home_state) &&
             home_timer_loaded(&y_home_state) &&
-            home_timer_loaded(&z_home_state));
+            home_timer_loaded(&z_home_state) &&
+            !segment.ss_pending);
 }
 
 
@@ -617,6 +684,7 @@ void init_scheduler(void)
     init_home_timer_state(&x_home_state);
     init_home_timer_state(&y_home_state);
     init_home_timer_state(&z_home_state);
+    init_segment_state(&segment);
 }
 
 void enqueue_dwell(void)
@@ -630,11 +698,13 @@ void enqueue_dwell(void)
     prep_motor_state(&y_state, mt, 0);
     prep_motor_state(&z_state, mt, 0);
     prep_laser_state(&p_state, mt, get_enum_variable(V_LS), 0);
+    prep_segment_state(&segment);
     do {
         gen_motor_atoms(&x_state, &Xq);
         gen_motor_atoms(&y_state, &Yq);
         gen_motor_atoms(&z_state, &Zq);
         gen_laser_atoms(&p_state, &Pq);
+        gen_segment_end(&segment, &p_state, &Pq);
         start_engine();
     } while (!all_timers_loaded(mt));
 }
@@ -644,17 +714,23 @@ void enqueue_move(void)
     if (fault_is_set(F_ES))
         return;
 
-    uint32_t mt = get_unsigned_variable(V_MT);
+    int32_t  xd = get_signed_variable(V_XD);
+    int32_t  yd = get_signed_variable(V_YD);
+    int32_t  zd = get_signed_variable(V_ZD);
+    uint32_t mt = override_move_time(get_unsigned_variable(V_MT),
+                                     major_distance(xd, yd, zd));
 
-    prep_motor_state(&x_state, mt, get_signed_variable(V_XD));
-    prep_motor_state(&y_state, mt, get_signed_variable(V_YD));
-    prep_motor_state(&z_state, mt, get_signed_variable(V_ZD));
+    prep_motor_state(&x_state, mt, xd);
+    prep_motor_state(&y_state, mt, yd);
+    prep_motor_state(&z_state, mt, zd);
     prep_laser_inactive(&p_state, mt);
+    prep_segment_state(&segment);
     do {
         gen_motor_atoms(&x_state, &Xq);
         gen_motor_atoms(&y_state, &Yq);
         gen_motor_atoms(&z_state, &Zq);
         gen_laser_atoms(&p_state, &Pq);
+        gen_segment_end(&segment, &p_state, &Pq);
         start_engine();
     } while (!all_timers_loaded(mt));
 }
@@ -664,22 +740,23 @@ void enqueue_cut(void)
     if (fault_is_set(F_ES))
         return;
 
-    uint32_t mt = get_unsigned_variable(V_MT);
-    int32_t  xd = get_signed_variable(V_XD);
-    int32_t  yd = get_signed_variable(V_YD);
-    int32_t  zd = get_signed_variable(V_ZD);
+    int32_t     xd = get_signed_variable(V_XD);
+    int32_t     yd = get_signed_variable(V_YD);
+    int32_t     zd = get_signed_variable(V_ZD);
+    uint_fast24 md = major_distance(xd, yd, zd);
+    uint32_t    mt = override_move_time(get_unsigned_variable(V_MT), md);
 
     prep_motor_state(&x_state, mt, xd);
     prep_motor_state(&y_state, mt, yd);
     prep_motor_state(&z_state, mt, zd);
-    prep_laser_state(&p_state, mt,
-                     get_enum_variable(V_LS),
-                     major_distance(xd, yd, zd));
+    prep_laser_state(&p_state, mt, get_enum_variable(V_LS), md);
+    prep_segment_state(&segment);
     do {
         gen_motor_atoms(&x_state, &Xq);
         gen_motor_atoms(&y_state, &Yq);
         gen_motor_atoms(&z_state, &Zq);
         gen_laser_atoms(&p_state, &Pq);
+        gen_segment_end(&segment, &p_state, &Pq);
         start_engine();
     } while (!all_timers_loaded(mt));
 }
@@ -712,16 +789,20 @@ void enqueue_home(void)
     init_motor_timer_state(&z_state);
 #endif
     prep_laser_inactive(&p_state, MIN_IVL);
+    prep_segment_state(&segment);
 
     do {
         gen_home_atoms(&x_home_state, &Xq);
         gen_home_atoms(&y_home_state, &Yq);
         gen_home_atoms(&z_home_state, &Zq);
-        if (!laser_timer_loaded(&p_state)) {
+        if (!laser_timer_loaded(&p_state) || segment.ss_pending) {
             // Tricky.  We must not call start_engine() when the laser
             // has stopped.  We must call start_engine when the engine
             // has not started.  (We may call it if neither applies.)
+            // The laser can't have stopped while its queue is too
+            // full for the segment end.
             gen_laser_atoms(&p_state, &Pq);
+            gen_segment_end(&segment, &p_state, &Pq);
             start_engine();
         }
     } while (!home_timers_loaded());
@@ -737,3 +818,18 @@ void await_completion(void)
 {
     await_engine_stopped();
 }
+
+void adjust_feed_override_NONATOMIC(int8_t delta)
+{
+    int16_t fo = delta ? feed_override + delta : 100;
+    if (fo < FEED_OVERRIDE_MIN)
+        fo = FEED_OVERRIDE_MIN;
+    if (fo > FEED_OVERRIDE_MAX)
+        fo = FEED_OVERRIDE_MAX;
+    feed_override = fo;
+}
+
+uint8_t get_feed_override(void)
+{
+    return feed_override;
+}
@@ -1,6 +1,8 @@
 #ifndef SCHEDULER_included
 #define SCHEDULER_included
 
+#include <stdint.h>
+
 extern void init_scheduler   (void);
 
 extern void enqueue_dwell    (void);
@@ -12,4 +14,13 @@ extern void enqueue_home     (void);
 extern void stop_immediately (void);
 extern void await_completion (void);
 
+// Feed override scales the speed of moves and cuts, in percent.  The
+// serial receive interrupt adjusts it when the host sends the control
+// bytes.  A delta of 0 resets it to 100%.
+#define FEED_OVERRIDE_MIN  10
+#define FEED_OVERRIDE_MAX 200
+
+extern void    adjust_feed_override_NONATOMIC (int8_t delta);
+extern uint8_t get_feed_override              (void);
+
 #endif /* !SCHEDULER_included */
@@ -3,13 +3,16 @@
 #include <util/atomic.h>
 
 #include "bufs.h"
+#include "engine.h"
 #include "fault.h"
 #include "fw_assert.h"
+#include "scheduler.h"
 
 //#define BAUD_RATE   9600
 #define BAUD_RATE 115200
 
 #define TX_BUF_SIZE  256
+#define TX_PUT_CHUNK  16
 
 #define RX_BUF_SIZE  256
 #define RX_FLOW_SHIFT  4
@@ -20,6 +23,25 @@
 #define ASCII_XON  '\021'
 #define ASCII_XOFF '\023'
 
+// Real-time control bytes.  Commands are ASCII, so bytes with the
+// high bit set are free.  These act as soon as they arrive and never
+// enter the receive buffer, so flow control doesn't count them.
+#define RT_FEED_HOLD          0x80
+#define RT_FEED_RESUME        0x81
+#define RT_FEED_RESET         0x82 // feed override = 100%
+#define RT_FEED_PLUS_10       0x83
+#define RT_FEED_MINUS_10      0x84
+#define RT_FEED_PLUS_1        0x85
+#define RT_FEED_MINUS_1       0x86
+#define RT_SYNC_CREDIT        0x87 // answer with CREDIT_SYNC
+
+// Flow control credit is 0xF0 | the RX head's high nibble.  CREDIT_SYNC
+// says the RX buffer is empty and the head is at 0, so the front end
+// can start counting from there.  It is sent at startup and in answer
+// to RT_SYNC_CREDIT, once the buffer holds no complete line.  A partial
+// line left by a dead link is discarded then.
+#define CREDIT_SYNC           0xE0
+
 // tx_buf and rx_buf are actually defined in bufs.c.
 //static uint8_t tx_buf[TX_BUF_SIZE] __attribute__((aligned(256)));
 static uint8_t tx_head;
@@ -32,6 +54,7 @@ static uint8_t rx_head;
 static uint8_t rx_tail;
 static uint8_t rx_errs;
 static uint8_t rx_line_count;
+static bool    rx_sync_pending;
 
 void init_serial(void)
 {
@@ -113,6 +136,36 @@ bool serial_tx_put_char(uint8_t c)
     return ok;
 }
 
+// Put a block of bytes, all or none.  The bytes are copied a few at a
+// time so interrupts are not held off for long.  If another producer
+// writes between pieces, the block is split, so callers must frame
+// their blocks so that the receiver can discard a split one.
+bool serial_tx_put_bytes(const uint8_t *data, uint8_t count)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if ((uint8_t)(tx_head - tx_tail - 1) < count) {
+            tx_errs |= SE_DATA_OVERRUN;
+            return false;
+        }
+    }
+    while (count) {
+        uint8_t n = count < TX_PUT_CHUNK ? count : TX_PUT_CHUNK;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            if ((uint8_t)(tx_head - tx_tail - 1) < n) {
+                tx_errs |= SE_DATA_OVERRUN;
+                return false;
+            }
+            for (uint8_t i = 0; i < n; i++) {
+                tx_buf[tx_tail] = *data++;
+                tx_tail = (tx_tail + 1) % TX_BUF_SIZE;
+            }
+            UCSR0B |= _BV(UDRIE0);
+        }
+        count -= n;
+    }
+    return true;
+}
+
 static inline void tx_send_oob_NONATOMIC(uint8_t c)
 {
     tx_oob_char = c;
@@ -135,11 +188,18 @@ ISR(USART0_UDRE_vect)
 
 // //  // //   // //  // //    // //  // //   // //  // //     // //  // //
 
+static inline void rx_sync_NONATOMIC(void)
+{
+    rx_head = rx_tail = 0;
+    rx_line_count = 0;
+    rx_sync_pending = false;
+    tx_send_oob_NONATOMIC(CREDIT_SYNC);
+}
+
 void serial_rx_start(void)
 {
     ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
-        rx_head = rx_tail = 0;
-        tx_send_oob_NONATOMIC(-(1 << RX_FLOW_SHIFT));
+        rx_sync_NONATOMIC();
     }
 }
 
@@ -198,23 +258,89 @@ uint8_t serial_rx_peek_char(uint8_t pos)
     return c;
 }
 
+// Release the first count chars.  The parser has already read them,
+// so EOLs are counted before the one atomic update.  Flow control
+// credit is sent when the head crosses a 2^RX_FLOW_SHIFT boundary.  The
+// credit encodes the new head position, so one credit covers any
+// number of boundaries.
 void serial_rx_consume(uint8_t count)
 {
+    uint8_t h = rx_head;        // only base level moves rx_head
+    uint8_t eol_count = 0;
+    for (uint8_t i = 0; i < count; i++)
+        if (is_eol_char(rx_buf[(uint8_t)(h + i)]))
+            eol_count++;
+    uint8_t new_head = h + count;
     ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
-        fw_assert(count <= serial_rx_char_count());
-        for (uint8_t i = 0; i < count; i++) {
-            uint8_t c = rx_buf[rx_head];
-            if (is_eol_char(c))
-                --rx_line_count;
-            rx_head++;
-            if (!(rx_head & ~-(1 << RX_FLOW_SHIFT))) {
-                uint8_t ack = rx_head >> RX_FLOW_SHIFT | -(1 << RX_FLOW_SHIFT);
-                tx_send_oob_NONATOMIC(ack);
-            }
+        fw_assert(count <= (uint8_t)(rx_tail - h));
+        rx_head = new_head;
+        rx_line_count -= eol_count;
+        if (rx_sync_pending && !rx_line_count)
+            rx_sync_NONATOMIC();
+        else if ((h & ~-(1 << RX_FLOW_SHIFT)) + count >=
+                 (1 << RX_FLOW_SHIFT)) {
+            uint8_t ack = new_head >> RX_FLOW_SHIFT | -(1 << RX_FLOW_SHIFT);
+            tx_send_oob_NONATOMIC(ack);
         }
     }
 }
 
+void serial_rx_take_snapshot(rx_snap *sp)
+{
+    uint8_t h, t;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        h = rx_head;
+        t = rx_tail;
+    }
+    sp->rs_head = h;
+    sp->rs_count = t - h;
+}
+
+static inline void do_realtime_control_NONATOMIC(uint8_t c)
+{
+    switch (c) {
+
+    case RT_FEED_HOLD:
+        feed_hold_NONATOMIC();
+        break;
+
+    case RT_FEED_RESUME:
+        feed_resume_NONATOMIC();
+        break;
+
+    case RT_FEED_RESET:
+        adjust_feed_override_NONATOMIC(0);
+        break;
+
+    case RT_FEED_PLUS_10:
+        adjust_feed_override_NONATOMIC(+10);
+        break;
+
+    case RT_FEED_MINUS_10:
+        adjust_feed_override_NONATOMIC(-10);
+        break;
+
+    case RT_FEED_PLUS_1:
+        adjust_feed_override_NONATOMIC(+1);
+        break;
+
+    case RT_FEED_MINUS_1:
+        adjust_feed_override_NONATOMIC(-1);
+        break;
+
+    case RT_SYNC_CREDIT:
+        if (rx_line_count)
+            rx_sync_pending = true;
+        else
+            rx_sync_NONATOMIC();
+        break;
+
+    default:
+        // Unknown control bytes are ignored.
+        break;
+    }
+}
+
 ISR(USART0_RX_vect)
 {
     rx_errs |= UCSR0A & (_BV(UPE0) | _BV(DOR0) | _BV(FE0));
@@ -222,6 +348,8 @@ ISR(USART0_RX_vect)
         uint8_t c = UDR0;
         if (c == ASCII_CAN)
             raise_fault(F_ES);
+        else if (c & 0x80)
+            do_realtime_control_NONATOMIC(c);
         else {
             uint8_t new_tail = rx_tail + 1;
             if (new_tail == rx_head)
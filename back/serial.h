@@ -6,6 +6,11 @@
 
 #include <avr/io.h>
 
+#include "bufs.h"
+#include "fw_assert.h"
+
+// Interface
+
 typedef enum serial_error_bit {
     SE_OK           = 0,
     SE_NO_DATA      = _BV(UDRE0), // 0x20
@@ -14,6 +19,16 @@ typedef enum serial_error_bit {
     SE_PARITY_ERROR = _BV(UPE0),  // 0x04
 } serial_error_bit;
 
+// A snapshot of the RX buffer.  When serial_rx_has_lines() is true,
+// the parser takes one snapshot and reads the whole line in place,
+// then releases it with one call to serial_rx_consume().  The buffer
+// is 256 bytes, so positions wrap at no cost.
+
+typedef struct serial_rx_snapshot {
+    uint8_t rs_head;            // buffer index of first char
+    uint8_t rs_count;           // number of chars in buffer
+} serial_rx_snapshot, rx_snap;
+
 extern void    init_serial            (void);
 
 extern void    serial_rx_start        (void);
@@ -26,11 +41,24 @@ extern uint8_t serial_rx_line_count   (void);
 extern uint8_t serial_rx_peek_char    (uint8_t pos);
 extern void    serial_rx_consume      (uint8_t count);
 
+extern        void    serial_rx_take_snapshot (rx_snap *);
+static inline uint8_t serial_rx_snapshot_char (const rx_snap *, uint8_t pos);
+
 extern uint8_t serial_tx_errors       (void);
 extern uint8_t serial_tx_peek_errors  (void);
 extern bool    serial_tx_is_idle      (void);
 extern uint8_t serial_tx_is_available (void);
 extern uint8_t serial_tx_char_count   (void);
 extern bool    serial_tx_put_char     (uint8_t c);
+extern bool    serial_tx_put_bytes    (const uint8_t *, uint8_t count);
+
+
+// Implementation
+
+static inline uint8_t serial_rx_snapshot_char(const rx_snap *sp, uint8_t pos)
+{
+    fw_assert(pos < sp->rs_count);
+    return rx_buf[(uint8_t)(sp->rs_head + pos)];
+}
 
 #endif /* !SERIAL_included */
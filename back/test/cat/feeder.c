@@ -12,6 +12,7 @@
 
 #define BACK_RX_BUF_SIZE 256
 #define FLOW_SHIFT 4
+#define CREDIT_SYNC 0xE0
 
 struct termios orig_tios, raw_tios;
 char     buf0[BUFSIZ];
@@ -126,7 +127,10 @@ int main()
                 for (i = 0; i < nr; i++) {
                     char c = buf1[i];
                     uint8_t uc = (uint8_t)c;
-                    if ((uc & 0xF0) == 0xF0) {
+                    if (uc == CREDIT_SYNC) {
+                        tx_received = tx_count = 0;
+                        tx_limit = 0xFF;
+                    } else if ((uc & 0xF0) == 0xF0) {
                         tx_mark = (uc & ~-(1 << FLOW_SHIFT)) << FLOW_SHIFT;
                         calc_limit(tx_mark);
                     } else {
@@ -5,15 +5,35 @@
 #include "fw_assert.h"
 #include "softint.h"
 
+// Timeouts are kept in a hierarchical timer wheel.  There are four
+// levels of 16 slots each.  Level 0 slots are 1 msec wide, level 1
+// slots 16 msec, level 2 slots 256 msec, and level 3 slots 4096
+// msec.  A timeout goes into the slot at the coarsest level that
+// still separates it from the current time.  Every 16 msec, the
+// current slot of the next level up is "cascaded": its timeouts are
+// redistributed into finer slots.
+//
+// Enqueue and dequeue are O(1), and each tick does O(1) work apart
+// from cascading, which touches each timeout at most once per level.
+//
+// wheel_time is the next tick the wheel will process.  The timer
+// interrupt advances it directly when the new tick has nothing to do;
+// otherwise the soft interrupt catches it up to the clock.
+
+#define WHEEL_BITS    4
+#define WHEEL_SLOTS   (1 << WHEEL_BITS)
+#define WHEEL_MASK    (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS  4
+
 struct timer_private timer_private;
-static timeout *timeout_queue;
 
-static inline int8_t compare_times(uint32_t t0, uint32_t t1)
+static timeout *wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+static uint32_t wheel_time = 1;
+static bool     wheel_is_busy;
+
+static inline uint8_t slot_index(uint32_t time, uint8_t level)
 {
-    int32_t t0s = t0;
-    int32_t t1s = t1;
-    int32_t d = t0s - t1s;
-    return d > 0 ? +1 : (d < 0 ? -1 : 0);
+    return time >> (level * WHEEL_BITS) & WHEEL_MASK;
 }
 
 void init_timer(void)
@@ -24,87 +44,145 @@ void init_timer(void)
     // Timer/Counter 0 clock select = prescale by 64.
     TCCR0B = _BV(WGM02) | _BV(CS00) | _BV(CS01);
 
-    // Output Compare Register 0A = 250 (1 millisecond);
-    #if F_CPU % (64L * 1000L) || F_CPU / 64 / 5000 >= 256
+    // Output Compare Register 0A = 249 (250 counts = 1 millisecond);
+    #if F_CPU % (64L * 1000L) || TIMER0_COUNTS > 256
         #error F_CPU does not work with prescale 64
     #endif
-    OCR0A = F_CPU / 64 / 1000;
+    #if 1000 % TIMER0_COUNTS
+        #error F_CPU does not give a whole number of usec per count
+    #endif
+    OCR0A = TIMER0_TOP;
 
     // Enable Timer/Counter 0 overflow interrupt.
     TIMSK0 = _BV(TOIE0);
 }
 
-static bool dequeue_timeout_NONATOMIC(timeout *newt)
+static void insert_timeout_NONATOMIC(timeout *t)
 {
-    timeout *p, **pp;
-
-    // Remove if already enqueued.
-    for (pp = &timeout_queue; (p = *pp); pp = &p->to_next) {
-        if (p == newt) {
-            *pp = p->to_next;
-            return true;
+    int32_t delta = t->to_expiration - wheel_time;
+    uint32_t when = t->to_expiration;
+    uint8_t level = 0;
+
+    if (delta < 0) {
+        // Already expired.  Run it on the next tick.
+        when = wheel_time;
+    } else {
+        while (level < WHEEL_LEVELS - 1 &&
+               delta >= 1L << ((level + 1) * WHEEL_BITS))
+            level++;
+        if (delta >= 1L << (WHEEL_LEVELS * WHEEL_BITS)) {
+            // Beyond the wheel.  Park it in the farthest slot; it will
+            // be reinserted when that slot is cascaded.
+            when = wheel_time + ((uint32_t)WHEEL_MASK << (level * WHEEL_BITS));
         }
     }
-    return false;
+    timeout **pp = &wheel[level][slot_index(when, level)];
+    t->to_next = *pp;
+    if (t->to_next)
+        t->to_next->to_pprev = &t->to_next;
+    t->to_pprev = pp;
+    *pp = t;
+}
+
+static bool dequeue_timeout_NONATOMIC(timeout *t)
+{
+    if (!t->to_pprev)
+        return false;
+    *t->to_pprev = t->to_next;
+    if (t->to_next)
+        t->to_next->to_pprev = t->to_pprev;
+    t->to_pprev = NULL;
+    return true;
 }
 
 void enqueue_timeout(timeout *newt, uint32_t expiration)
 {
     ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
-
-        timeout *p, **pp;
-
-        // Dequeue if already enqueued.
         dequeue_timeout_NONATOMIC(newt);
-
-        // Find spot and insert.
-        for (pp = &timeout_queue; (p = *pp); pp = &p->to_next) {
-            fw_assert(p != newt);
-            if (compare_times(p->to_expiration, expiration) > 0)
-                break;
-        }
         newt->to_expiration = expiration;
-        newt->to_next = p;
-        *pp = newt;
+        insert_timeout_NONATOMIC(newt);
     }
 }
 
-bool dequeue_timeout(timeout *newt)
+bool dequeue_timeout(timeout *t)
 {
     bool dequeued;
     ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
-        dequeued = dequeue_timeout_NONATOMIC(newt);
+        dequeued = dequeue_timeout_NONATOMIC(t);
     }
     return dequeued;
 }
 
+// Does tick `time' have anything to do?
+static inline bool tick_is_busy_NONATOMIC(uint32_t time)
+{
+    if (wheel[0][slot_index(time, 0)])
+        return true;
+    for (uint8_t level = 1; level < WHEEL_LEVELS; level++) {
+        if (slot_index(time, level - 1))
+            break;
+        if (wheel[level][slot_index(time, level)])
+            return true;
+    }
+    return false;
+}
+
+// Move the current slot at each level whose period starts now down
+// into finer slots.
+static void cascade_NONATOMIC(uint32_t time)
+{
+    for (uint8_t level = 1; level < WHEEL_LEVELS; level++) {
+        if (slot_index(time, level - 1))
+            break;
+        timeout **pp = &wheel[level][slot_index(time, level)];
+        timeout *t = *pp;
+        *pp = NULL;
+        while (t) {
+            timeout *next = t->to_next;
+            insert_timeout_NONATOMIC(t);
+            t = next;
+        }
+    }
+}
+
 void timer_softint(void)
 {
     while (true) {
-        timeout *head = NULL;
+        uint32_t time;
         ATOMIC_BLOCK(ATOMIC_FORCEON) {
-            if (timeout_queue &&
-                compare_times(millisecond_time_NONATOMIC(),
-                              timeout_queue->to_expiration) >= 0) {
-                head = timeout_queue;
-                timeout_queue = head->to_next;
+            time = wheel_time;
+            if ((int32_t)(millisecond_time_NONATOMIC() - time) < 0) {
+                wheel_is_busy = false;
+                return;
             }
+            cascade_NONATOMIC(time);
         }
-        if (!head)
-            break;
-        if (head->to_interval) {
-            head->to_expiration += head->to_interval;
-            enqueue_timeout(head, head->to_expiration);
+        while (true) {
+            timeout *t;
+            ATOMIC_BLOCK(ATOMIC_FORCEON) {
+                t = wheel[0][slot_index(time, 0)];
+                if (t) {
+                    dequeue_timeout_NONATOMIC(t);
+                    if (t->to_interval) {
+                        t->to_expiration += t->to_interval;
+                        insert_timeout_NONATOMIC(t);
+                    }
+                } else
+                    wheel_time = time + 1;
+            }
+            if (!t)
+                break;
+            (*t->to_func)();
         }
-        (*head->to_func)();
     }
 }
 
 ISR_TRIGGERS_SOFTINT(TIMER0_OVF_vect)
 {
-    timer_private.ticks++;
-    if (timeout_queue &&
-        compare_times(timer_private.ticks, timeout_queue->to_expiration) > 0) {
+    uint32_t time = ++timer_private.ticks;
+    if (wheel_is_busy || tick_is_busy_NONATOMIC(time)) {
+        wheel_is_busy = true;
         trigger_softint_from_hardint(ST_TIMER);
-    }
+    } else
+        wheel_time = time + 1;
 }
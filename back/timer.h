@@ -5,6 +5,7 @@
 #include <stdint.h>
 
 #include <avr/interrupt.h>
+#include <avr/io.h>
 #include <util/atomic.h>
 
 
@@ -18,14 +19,17 @@ typedef struct timeout {
     timeout_func   *to_func;
 
     // timer.c maintains these.
-    struct timeout *to_next;
-    uint32_t        to_expiration;
+    struct timeout  *to_next;
+    struct timeout **to_pprev;  // NULL when not enqueued
+    uint32_t         to_expiration;
 } timeout;
 
 extern        void     init_timer                 (void);
 
 static inline uint32_t millisecond_time_NONATOMIC (void);
 static inline uint32_t millisecond_time           (void);
+static inline uint32_t microsecond_time_NONATOMIC (void);
+static inline uint32_t microsecond_time           (void);
 
 extern        void     enqueue_timeout            (timeout *,
                                                    uint32_t expiration);
@@ -35,6 +39,11 @@ extern        void     timer_softint              (void);
 
 // Implementation
 
+// Timer 0 counts TIMER0_COUNTS times per millisecond.
+#define TIMER0_COUNTS       (F_CPU / 64 / 1000)
+#define TIMER0_TOP          (TIMER0_COUNTS - 1)
+#define USEC_PER_COUNT      (1000 / TIMER0_COUNTS)
+
 extern struct timer_private {
     uint32_t ticks;
 } timer_private;
@@ -53,4 +62,30 @@ static inline uint32_t millisecond_time(void)
     return now;
 }
 
+// The microsecond clock combines the millisecond tick count with
+// Timer 0's count.  The tick is counted when the timer reaches TOP,
+// so TOP is the first count of a millisecond, not the last.  If the
+// overflow interrupt is pending, the tick count is one behind unless
+// the timer overflowed after TCNT0 was read.  The clock wraps every
+// 71 minutes, so use it only for intervals.
+
+static inline uint32_t microsecond_time_NONATOMIC(void)
+{
+    uint32_t ms = timer_private.ticks;
+    uint8_t count = TCNT0;
+    uint8_t phase = count == TIMER0_TOP ? 0 : count + 1;
+    if (bit_is_set(TIFR0, TOV0) && phase < TIMER0_COUNTS / 2)
+        ms++;
+    return ms * 1000 + phase * USEC_PER_COUNT;
+}
+
+static inline uint32_t microsecond_time(void)
+{
+    uint32_t now;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        now = microsecond_time_NONATOMIC();
+    }
+    return now;
+}
+
 #endif /* !TIMER_included */
@@ -2,6 +2,7 @@
 
 #ifndef FW_NDEBUG
 
+#include <inttypes.h>
 #include <stdio.h>
 
 #include <avr/pgmspace.h>
@@ -13,10 +14,12 @@ struct trace_private trace_private;
 void print_trace(void)
 {
     size_t count = trace_private.tp_pos;
+    uint32_t t0 = count ? trace_private.tp_buffer[0].te_usec : 0;
     printf_P(PSTR("\nTRACE\n"));
     for (size_t i = 0; i < count; i++) {
         const trace_entry *ep = &trace_private.tp_buffer[i];
-        printf_P(PSTR("%s:%u: "), ep->te_func, ep->te_line);
+        printf_P(PSTR("%8"PRIu32" %s:%u: "),
+                 ep->te_usec - t0, ep->te_func, ep->te_line);
         uint16_t code = ep->te_code;
         uint8_t c = ep->te_code;
         printf_P(PSTR("%4"PRIx16" "), code);
@@ -6,6 +6,8 @@
 
 #include <util/atomic.h>
 
+#include "timer.h"
+
 
 // Interface
 
@@ -34,6 +36,7 @@ typedef struct trace_entry {
     const char *te_func;
     uint16_t    te_line;
     uint16_t    te_code;
+    uint32_t    te_usec;
 } trace_entry;
 
 extern struct trace_private {
@@ -49,6 +52,7 @@ static inline void trace(const char *func, uint16_t line, uint16_t code)
             ep->te_func = func;
             ep->te_line = line;
             ep->te_code = code;
+            ep->te_usec = microsecond_time_NONATOMIC();
         }
     }
 }
@@ -4,6 +4,9 @@
 #include <string.h>
 
 #include <avr/pgmspace.h>
+#include <util/atomic.h>
+
+#include "config/proto-defs.h"
 
 #define MAX_OBSERVERS 1
 
@@ -12,88 +15,29 @@
 #define DESC_TYPE_OFFSET 3
 #define DESC_ENUM_OFFSET 4
 
-#define UNSIGNED "\026"
-#define SIGNED   "\023"
-#define ENUM     "\005"
-
-#define DEFINE_DESC(name, type, ...) \
-    static const char name##_desc[] PROGMEM = #name "=" type __VA_ARGS__
-
-DEFINE_DESC(ia, ENUM, "ncswa"); // illumination animation
-DEFINE_DESC(il, UNSIGNED);      // illumination level
-DEFINE_DESC(lp, UNSIGNED);      // laser power
-DEFINE_DESC(ls, ENUM, "nmv");   // laser select
-DEFINE_DESC(mt, UNSIGNED);      // move time
-DEFINE_DESC(oc, ENUM, "ny");    // override lid closed
-DEFINE_DESC(oo, ENUM, "ny");    // override lid open
-DEFINE_DESC(pd, UNSIGNED);      // pulse distance
-DEFINE_DESC(pi, UNSIGNED);      // pulse interval
-DEFINE_DESC(pm, ENUM, "octd");  // pulse mode
-DEFINE_DESC(pw, UNSIGNED);      // pulse width
-DEFINE_DESC(re, ENUM, "yn");    // report E-Stop status
-DEFINE_DESC(rf, ENUM, "yn");    // report fault status
-DEFINE_DESC(ri, UNSIGNED);      // reporting interval
-DEFINE_DESC(rl, ENUM, "ny");    // report limit switch status
-DEFINE_DESC(rm, ENUM, "ny");    // report motor status
-DEFINE_DESC(rp, ENUM, "ny");    // report power status
-DEFINE_DESC(rq, ENUM, "ny");    // report queue status
-DEFINE_DESC(rr, ENUM, "ny");    // report RAM status
-DEFINE_DESC(rs, ENUM, "ny");    // report serial status
-DEFINE_DESC(rv, ENUM, "ny");    // report variables
-DEFINE_DESC(rw, ENUM, "ny");    // report water status
-DEFINE_DESC(xd, SIGNED);        // X distance
-DEFINE_DESC(yd, SIGNED);        // Y distance
-DEFINE_DESC(zd, SIGNED);        // Z distance
-
-static PGM_P const variable_descriptors[VARIABLE_COUNT] PROGMEM = {
-    ia_desc,
-    il_desc,
-    lp_desc,
-    ls_desc,
-    mt_desc,
-    oc_desc,
-    oo_desc,
-    pd_desc,
-    pi_desc,
-    pm_desc,
-    pw_desc,
-    re_desc,
-    rf_desc,
-    ri_desc,
-    rl_desc,
-    rm_desc,
-    rp_desc,
-    rq_desc,
-    rr_desc,
-    rs_desc,
-    rv_desc,
-    rw_desc,
-    xd_desc,
-    yd_desc,
-    zd_desc,
-};
+// A descriptor is the name, '=', the type code, and for enumerations
+// the allowed values, default first.  E.g., "ls=\005nmv".
+static const char variable_descriptors[VARIABLE_COUNT][VAR_DESC_SIZE]
+    PROGMEM = VARIABLE_DESCRIPTORS_INIT;
+
+// Variables are found by direct indexing on the two name characters.
+// The tables are generated from config/protocol.py.
+
+static const uint8_t variable_rows[26] PROGMEM = VARIABLE_ROWS_INIT;
+
+static const uint8_t variable_table[VARIABLE_ROW_COUNT][VARIABLE_COL_COUNT]
+    PROGMEM = VARIABLE_TABLE_INIT;
+
+const uint8_t variable_flags[VARIABLE_COUNT] PROGMEM = VARIABLE_FLAGS_INIT;
 
 static v_observ *observers[VARIABLE_COUNT][MAX_OBSERVERS];
 
 struct variables_private variables_private;
 
-static int8_t cmp2(const char *a, const char *b)
-{
-    if (a[0] > b[0])
-        return +1;
-    if (a[0] < b[0])
-        return -1;
-    if (a[1] > b[1])
-        return +1;
-    if (a[1] < b[1])
-        return -1;
-    return 0;
-}
-
 static PGM_P desc_addr(v_index index)
 {
     fw_assert(index < VARIABLE_COUNT);
-    return (PGM_P) pgm_read_word(&variable_descriptors[index]);
+    return variable_descriptors[index];
 }
 
 static void notify_observers(v_index index)
@@ -109,13 +53,12 @@ static void notify_observers(v_index index)
 void init_variables(void)
 {
 #ifndef FW_NDEBUG
-    v_name name, prev_name;
+    v_name name;
     size_t max_len = 0;
     for (v_index i = 0; i < VARIABLE_COUNT; i++) {
         get_variable_name(i, &name);
-        if (i)
-            fw_assert(cmp2(prev_name, name) < 0);
-        strcpy(prev_name, name);
+        fw_assert(lookup_variable(name) == i);
+        fw_assert(!(OBSERVED_VARIABLES >> i & 1) == !variable_is_observed(i));
 
         size_t len = strlen_P(desc_addr(i));
         if (max_len < len)
@@ -151,35 +94,43 @@ void reset_all_variables(void)
             continue;
         }
         variables_private.vp_values[i] = value;
+        variables_private.vp_changed[i] = true;
     }
 }
 
-void set_variable(v_index index, v_value value)
+void set_observed_variable(v_index index, v_value value)
 {
-    fw_assert(index < VARIABLE_COUNT);
+    fw_assert(variable_is_observed(index));
     v_value prev = variables_private.vp_values[index];
     variables_private.vp_values[index] = value;
     if (value.vv_unsigned != prev.vv_unsigned) {
+        variables_private.vp_changed[index] = true;
         notify_observers(index);
     }
 }
 
-v_index lookup_variable(const char *name)
+// The flag is set at base level and taken by the reporter, which may
+// run in a soft interrupt.  Setting a flag is a single byte store, but
+// reading and clearing it must be atomic.
+bool take_variable_change(v_index index)
 {
-    v_index lo = 0, hi = VARIABLE_COUNT;
-    while (lo < hi) {
-        v_index mid = (lo + hi) / 2;
-        v_name mid_name;
-        get_variable_name(mid, &mid_name);
-        int8_t c = cmp2(name, mid_name);
-        if (c == 0)
-            return mid;
-        if (c < 0)
-            hi = mid;
-        else
-            lo = mid + 1;
+    fw_assert(index < VARIABLE_COUNT);
+    bool changed;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        changed = variables_private.vp_changed[index];
+        variables_private.vp_changed[index] = false;
     }
-    return VAR_NOT_FOUND;
+    return changed;
+}
+
+v_index lookup_variable(const char *name)
+{
+    uint8_t row = name[0] - 'a';
+    uint8_t col = name[1] - 'a';
+    if (row >= sizeof variable_rows || col >= VARIABLE_COL_COUNT)
+        return VAR_NOT_FOUND;
+    row = pgm_read_byte(&variable_rows[row]);
+    return pgm_read_byte(&variable_table[row][col]);
 }
 
 void get_variable_desc(v_index index, v_desc *out)
@@ -212,6 +163,7 @@ bool variable_enum_is_OK(v_index index, char e)
 
 void observe_variable(v_index index, v_observ func)
 {
+    fw_assert(variable_is_observed(index));
     v_observ **p = observers[index];
     uint8_t i;
     for (i = 0; i < MAX_OBSERVERS && p[i]; i++)
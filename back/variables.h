@@ -4,40 +4,20 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include <avr/pgmspace.h>
+
+#include "config/proto-defs.h"
+
 #include "fw_assert.h"
 
 // Interface
 
 #define VAR_NOT_FOUND 0xFF      // returned by lookup_variable()
 #define VAR_NAME_SIZE    3      // name size, including NUL byte
-#define VAR_DESC_SIZE   10      // descriptor size, including NUL byte
 
+// The variables are defined in config/protocol.py.
 typedef enum variable_index {
-    V_IA,                       // illumination animation
-    V_IL,                       // illumination level
-    V_LP,                       // laser power
-    V_LS,                       // laser select
-    V_MT,                       // move time
-    V_OC,                       // override lid closed
-    V_OO,                       // override lid open
-    V_PD,                       // pulse distance
-    V_PI,                       // pulse interval
-    V_PM,                       // pulse mode
-    V_PW,                       // pulse width
-    V_RE,                       // report E-Stop status
-    V_RF,                       // report fault status
-    V_RI,                       // reporting interval (milliseconds)
-    V_RL,                       // report limit switch status
-    V_RM,                       // report motor status
-    V_RP,                       // report power status
-    V_RQ,                       // report queue status
-    V_RR,                       // report RAM status
-    V_RS,                       // report serial status
-    V_RV,                       // report variables
-    V_RW,                       // report water status
-    V_XD,                       // X distance
-    V_YD,                       // Y distance
-    V_ZD,                       // Z distance
+    VARIABLE_INDEX_ENUMERATORS
     VARIABLE_COUNT
 } variable_index, v_index;
 
@@ -47,6 +27,11 @@ typedef enum variable_type {
     VT_ENUM     = 005,
 } variable_type, v_type;
 
+// Per-variable flags, from config/protocol.py.
+typedef enum variable_flag {
+    VF_OBSERVED = 1 << 0,       // may have observers
+} variable_flag;
+
 typedef union variable_value {
     uint32_t    vv_unsigned;
     int32_t     vv_signed;
@@ -68,7 +53,7 @@ static inline uint32_t get_unsigned_variable (v_index index);
 static inline int32_t  get_signed_variable   (v_index index);
 static inline uint8_t  get_enum_variable     (v_index index);
 
-extern        void     set_variable          (v_index, v_value);
+static inline void     set_variable          (v_index, v_value);
 static inline void     set_unsigned_variable (v_index index, uint32_t);
 static inline void     set_signed_variable   (v_index index, int32_t);
 static inline void     set_enum_variable     (v_index index, uint8_t);
@@ -78,17 +63,27 @@ extern        v_index  lookup_variable       (const char *name);
 extern        void     get_variable_desc     (v_index index, v_desc *out);
 extern        void     get_variable_name     (v_index index, v_name *out);
 extern        v_type   get_variable_type     (v_index index);
+static inline bool     variable_is_observed  (v_index index);
 extern        bool     variable_enum_is_OK   (v_index index, char e);
 
 // Observer interface
 extern        void     observe_variable      (v_index index, v_observ func);
 
+// Change tracking.  Each variable has a flag that is set when its
+// value changes.  take_variable_change() reads and clears it.
+extern        bool     take_variable_change  (v_index index);
+
 // Implementation
 
 extern struct variables_private {
     v_value vp_values[VARIABLE_COUNT];
+    bool    vp_changed[VARIABLE_COUNT];
 } variables_private;
 
+extern const uint8_t variable_flags[VARIABLE_COUNT] PROGMEM;
+
+extern void set_observed_variable(v_index, v_value);
+
 static inline v_value get_variable(v_index index)
 {
     fw_assert(index < VARIABLE_COUNT);
@@ -113,11 +108,26 @@ static inline uint8_t get_enum_variable(v_index index)
     return get_variable(index).vv_enum;
 }
 
-// static inline void set_variable(v_index index, v_value value)
-// {
-//     fw_assert(index < VARIABLE_COUNT);
-//     variables_private.vp_values[index] = value;
-// }
+static inline bool variable_is_observed(v_index index)
+{
+    fw_assert(index < VARIABLE_COUNT);
+    if (__builtin_constant_p(index))
+        return OBSERVED_VARIABLES >> index & 1;
+    return pgm_read_byte(&variable_flags[index]) & VF_OBSERVED;
+}
+
+// Variables without observers are stored inline.
+static inline void set_variable(v_index index, v_value value)
+{
+    fw_assert(index < VARIABLE_COUNT);
+    if (variable_is_observed(index))
+        set_observed_variable(index, value);
+    else if (variables_private.vp_values[index].vv_unsigned !=
+             value.vv_unsigned) {
+        variables_private.vp_values[index] = value;
+        variables_private.vp_changed[index] = true;
+    }
+}
 
 static inline void set_unsigned_variable(v_index index, uint32_t u)
 {
@@ -0,0 +1,8 @@
+#ifndef PROTO_DEFS_included
+#define PROTO_DEFS_included
+
+%AUTOGEN-DISCLAIMER%
+
+%DEFINITIONS%
+
+#endif /* !PROTO_DEFS_included */
@@ -0,0 +1,149 @@
+# Serial protocol: commands, variables and faults.
+#
+# This file is the one definition of the protocol.  From it,
+# tools/bin/gen-proto-defs.py generates config/proto-defs.h for the
+# firmware and proto_defs.py for kbmon and gcode.
+#
+# A command name is one capital letter, optionally followed by one
+# lower case letter.  A variable name is two lower case letters.
+
+
+# Commands
+
+def_command       ('Da',    'disable_air_pump')
+def_command       ('Dh',    'disable_high_voltage')
+def_command       ('Dl',    'disable_low_voltage')
+def_command       ('Dr',    'disable_reporting')
+def_command       ('Dw',    'disable_water_pump')
+def_command       ('Dx',    'disable_X_motor')
+def_command       ('Dy',    'disable_Y_motor')
+def_command       ('Dz',    'disable_Z_motor')
+
+def_command       ('Ea',    'enable_air_pump')
+def_command       ('Eh',    'enable_high_voltage')
+def_command       ('El',    'enable_low_voltage')
+def_command       ('Er',    'enable_reporting')
+def_command       ('Ew',    'enable_water_pump')
+def_command       ('Ex',    'enable_X_motor')
+def_command       ('Ey',    'enable_Y_motor')
+def_command       ('Ez',    'enable_Z_motor')
+
+def_command       ('I',     'illuminate')
+def_command       ('P',     'power')
+
+def_command       ('Qc',    'enqueue_cut')
+def_command       ('Qd',    'enqueue_dwell')
+def_command       ('Qe',    'enqueue_engrave')
+def_command       ('Qh',    'enqueue_home')
+def_command       ('Qm',    'enqueue_move')
+
+def_command       ('R',     'report_status')
+def_command       ('S',     'stop')
+def_command       ('W',     'wait')
+
+
+# Enumerations
+#
+# Each value is (code, name, label).  The first value is the default.
+
+ny    = def_enum(('n', 'no',         'No'),
+                 ('y', 'yes',        'Yes'))
+
+yn    = def_enum(('y', 'yes',        'Yes'),
+                 ('n', 'no',         'No'))
+
+ncswa = def_enum(('n', 'none',       'None'),
+                 ('c', 'complete',   'Complete'),
+                 ('s', 'startup',    'Startup'),
+                 ('w', 'warning',    'Warning'),
+                 ('a', 'alert',      'Alert'))
+
+nmv   = def_enum(('n', 'none',       'None'),
+                 ('m', 'main',       'Main Laser'),
+                 ('v', 'visible',    'Visible Laser'))
+
+octd  = def_enum(('o', 'off',        'Off'),
+                 ('c', 'continuous', 'Continuous'),
+                 ('t', 'timed',      'Timed'),
+                 ('d', 'distance',   'Distance'))
+
+
+# Variables
+#
+# Variables are numbered in the order listed here.  Each has a type
+# (unsigned, signed, or an enumeration), a short name and a full name.
+#
+# Options:
+#   observed - observers may be attached with observe_variable().
+#              Other variables are stored inline, with no callbacks.
+#   report   - the variable enables a status report.  The value names
+#              the report function in back/report.c.
+
+def_variable      ('ia', ncswa,    'Illum. Anim.',    'Illumination Animation')
+def_variable      ('il', unsigned, 'Illum. Level',    'Illumination Level')
+def_variable      ('lp', unsigned, 'Laser Power',     'Laser Power')
+def_variable      ('ls', nmv,      'Laser Select',    'Laser Select',
+                   observed=True)
+def_variable      ('mt', unsigned, 'Move Time',       'Move Time')
+def_variable      ('oc', ny,       "O'ride Lid Shut", 'Override Lid Closed',
+                   observed=True)
+def_variable      ('oo', ny,       "O'ride Lid Open", 'Override Lid Open',
+                   observed=True)
+def_variable      ('pd', unsigned, 'Pulse Distance',  'Pulse Distance')
+def_variable      ('pi', unsigned, 'Pulse Interval',  'Pulse Interval')
+def_variable      ('pm', octd,     'Pulse Mode',      'Pulse Mode')
+def_variable      ('pw', unsigned, 'Pulse Width',     'Pulse Width')
+def_variable      ('ra', yn,       'Report Axes',     'Report Axis Positions',
+                   report='positions')
+def_variable      ('re', yn,       'Report E-Stop',   'Report Emergency Stop Status',
+                   report='e_stop')
+def_variable      ('rf', yn,       'Report Faults',   'Report Fault Status',
+                   report='faults')
+def_variable      ('ri', unsigned, 'Rep. Interval',   'Reporting Interval (msec)')
+def_variable      ('rl', ny,       'Report Limits',   'Report Limit Switch Status',
+                   report='limit_switches')
+def_variable      ('rm', ny,       'Report Motors',   'Report Motor Status',
+                   report='motors')
+def_variable      ('rn', ny,       'Report Seg. Nums', 'Report Segment Numbers',
+                   report='segments')
+def_variable      ('ro', ny,       "Report O'rides",  'Report Feed Override and Hold',
+                   report='overrides')
+def_variable      ('rp', ny,       'Report Power',    'Report Power Status',
+                   report='power')
+def_variable      ('rq', ny,       'Report Queues',   'Report Queue Status',
+                   report='queues')
+def_variable      ('rr', ny,       'Report RAM Use',  'Report RAM Status',
+                   report='RAM')
+def_variable      ('rs', ny,       'Report Serial',   'Report Serial Status',
+                   report='serial')
+def_variable      ('rt', ny,       'Report Timing',   'Report Latency Histograms',
+                   report='timing')
+def_variable      ('rv', ny,       'Report Vars',     'Report Variables',
+                   report='variables')
+def_variable      ('rw', ny,       'Report Water',    'Report Water Status',
+                   report='water')
+def_variable      ('sn', unsigned, 'Segment Number',  'Next Segment Number')
+def_variable      ('xd', signed,   'X Distance',      'X Distance')
+def_variable      ('yd', signed,   'Y Distance',      'Y Distance')
+def_variable      ('zd', signed,   'Z Distance',      'Z Distance')
+
+
+# Faults
+#
+# Faults are numbered in the order listed here; the firmware keeps
+# them as bits in a 16 bit word.  A fault name is two capital letters.
+
+def_fault         ('ES',    'Emergency Stop')
+def_fault         ('LO',    'Lid Open')
+def_fault         ('LC',    'Lid Closed')
+def_fault         ('WF',    'Water Flow')
+def_fault         ('WT',    'Water Temperature')
+def_fault         ('LS',    'Limit Switch Stuck')
+def_fault         ('SF',    'Serial Frame Error')
+def_fault         ('SO',    'Serial Overrun')
+def_fault         ('SP',    'Serial Parity Error')
+def_fault         ('SL',    'Software Lexical Error')
+def_fault         ('SS',    'Software Syntax Error')
+def_fault         ('SU',    'Software Underflow')
+def_fault         ('SI',    'Software Missed Interrupt')
+def_fault         ('LP',    'Laser Power DAC Error')
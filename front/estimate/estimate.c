@@ -0,0 +1,235 @@
+#include <errno.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "back/scheduler.h"
+#include "front/thruport/serial.h"
+
+#include "model.h"
+
+// Estimate reads an S-code job and reports how long the machine will
+// take to run it.  The back end's scheduler, compiled for the host,
+// turns each enqueue command into atoms exactly as the back end
+// would; see model.c.
+//
+// The estimate also follows the job down the serial link.  The back
+// end can't schedule a segment until its command has arrived.  If the
+// queues run dry first, motion stops partway through the job.  That
+// is reported as an underflow, with the line that arrived too late.
+
+typedef struct estimate {
+    double   e_link_rate;       // bytes/second
+    size_t   e_bytes;           // bytes sent so far
+    double   e_end;             // when queued motion ends, seconds
+    bool     e_running;         // queued motion since the last wait
+    double   e_stall;           // total time stalled
+    unsigned e_underflows;
+    unsigned e_fast_steps;
+    unsigned e_errors;
+} estimate;
+
+static double ticks_to_secs(uint64_t ticks)
+{
+    return (double)ticks / F_CPU;
+}
+
+static const char *format_time(double secs, char *buf, size_t size)
+{
+    unsigned long s = secs;
+    if (s >= 3600)
+        snprintf(buf, size, "%lu:%02lu:%04.1f",
+                 s / 3600, s / 60 % 60, secs - s / 60 * 60);
+    else
+        snprintf(buf, size, "%lu:%04.1f", s / 60, secs - s / 60 * 60);
+    return buf;
+}
+
+// A segment starts when the back end has both read its command and
+// finished the queued motion.
+static void time_segment(estimate *ep,
+                         const char *file,
+                         unsigned line_no,
+                         uint64_t ticks)
+{
+    double arrival = ep->e_bytes / ep->e_link_rate;
+    double start = ep->e_end;
+    if (arrival > start) {
+        if (ep->e_running) {
+            fprintf(stderr,
+                    "%s:%u: underflow: arrives %.1f ms after the "
+                    "queues run dry\n",
+                    file, line_no, 1000 * (arrival - start));
+            ep->e_underflows++;
+            ep->e_stall += arrival - start;
+        }
+        start = arrival;
+    }
+    ep->e_end = start + ticks_to_secs(ticks);
+    ep->e_running = true;
+
+    uint16_t step = model_min_step();
+    if (step && step < model_min_interval) {
+        fprintf(stderr,
+                "%s:%u: warning: steps %u ticks apart, under the "
+                "engine's %u tick minimum\n",
+                file, line_no, step, model_min_interval);
+        ep->e_fast_steps++;
+    }
+}
+
+static void estimate_stream(estimate *ep, FILE *in, const char *file)
+{
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t nr;
+    unsigned line_no = 0;
+    while ((nr = getline(&line, &size, in)) > 0) {
+        line_no++;
+        ep->e_bytes += nr;
+        line[strcspn(line, "\n")] = '\0';
+        uint64_t before = model_ticks();
+        const char *err;
+        switch (model_execute(line, &err)) {
+
+        case ML_SEGMENT:
+            time_segment(ep, file, line_no, model_ticks() - before);
+            break;
+
+        case ML_HOME:
+        case ML_WAIT:
+            ep->e_running = false;
+            break;
+
+        case ML_ERROR:
+            fprintf(stderr, "%s:%u: %s\n", file, line_no, err);
+            ep->e_errors++;
+            break;
+
+        default:
+            break;
+        }
+    }
+    free(line);
+}
+
+static void print_report(const estimate *ep)
+{
+    model_stats st;
+    model_get_stats(&st);
+    char b0[20], b1[20];
+    double machine = ticks_to_secs(st.ms_ticks);
+    uint64_t total = 0;
+    for (size_t i = 0; i < MQ_COUNT; i++)
+        total += st.ms_atoms[i];
+
+    printf("segments          %u\n", st.ms_segments);
+    printf("machine time      %s\n", format_time(machine, b0, sizeof b0));
+    printf("main laser on     %s\n",
+           format_time(ticks_to_secs(st.ms_main_laser_ticks),
+                       b0, sizeof b0));
+    if (st.ms_visible_laser_ticks)
+        printf("visible laser on  %s\n",
+               format_time(ticks_to_secs(st.ms_visible_laser_ticks),
+                           b0, sizeof b0));
+    printf("link time         %s at %.0f bytes/s\n",
+           format_time(ep->e_bytes / ep->e_link_rate, b0, sizeof b0),
+           ep->e_link_rate);
+    printf("job time          %s, %s stalled\n",
+           format_time(ep->e_end, b0, sizeof b0),
+           format_time(ep->e_stall, b1, sizeof b1));
+    printf("atoms             X %llu  Y %llu  Z %llu  P %llu  "
+           "total %llu\n",
+           (unsigned long long)st.ms_atoms[MQ_X],
+           (unsigned long long)st.ms_atoms[MQ_Y],
+           (unsigned long long)st.ms_atoms[MQ_Z],
+           (unsigned long long)st.ms_atoms[MQ_P],
+           (unsigned long long)total);
+    printf("peak atom rate    %u atoms/s at %s\n",
+           st.ms_peak_atoms * (unsigned)(F_CPU / MODEL_WINDOW_TICKS),
+           format_time(ticks_to_secs(st.ms_peak_ticks), b0, sizeof b0));
+    printf("underflows        %u\n", ep->e_underflows);
+    if (ep->e_fast_steps)
+        printf("too fast          %u segments\n", ep->e_fast_steps);
+    if (st.ms_homes)
+        printf("homing            %u times, not included\n", st.ms_homes);
+}
+
+static void usage(FILE *out) __attribute__((noreturn));
+
+static void usage(FILE *out)
+{
+    static const char *msg =
+        "Use: estimate [options] [file...]\n"
+        "\n"
+        "Estimates the time an S-code job will take.\n"
+        "\n"
+        "Options:\n"
+        "  -f, --feed=PERCENT  Assume a feed override.  Default 100.\n"
+        "  -r, --rate=BYTES    Serial link rate in bytes/second.\n"
+        "  -h, --help          Display help text.\n"
+        "\n";
+    fputs(msg, out);
+    exit(out != stdout);
+}
+
+static const struct option options[] = {
+    { "feed",           required_argument, NULL, 'f' },
+    { "rate",           required_argument, NULL, 'r' },
+    { "help",                 no_argument, NULL, 'h' },
+    {  NULL,                            0, NULL,  0  }
+};
+
+int main(int argc, char *argv[])
+{
+    int feed = 100;
+    estimate est = {
+        .e_link_rate = SERIAL_BYTES_PER_SEC,
+    };
+    while (true) {
+        int c = getopt_long(argc, argv, "f:r:h", options, NULL);
+        if (c == -1)
+            break;
+
+        switch (c) {
+
+        case 'f':
+            feed = atoi(optarg);
+            if (feed < FEED_OVERRIDE_MIN || feed > FEED_OVERRIDE_MAX) {
+                fprintf(stderr, "estimate: feed must be %d to %d%%\n",
+                        FEED_OVERRIDE_MIN, FEED_OVERRIDE_MAX);
+                exit(EXIT_FAILURE);
+            }
+            break;
+
+        case 'r':
+            est.e_link_rate = atof(optarg);
+            if (est.e_link_rate <= 0)
+                usage(stderr);
+            break;
+
+        case 'h':
+            usage(stdout);
+
+        default:
+            usage(stderr);
+        }
+    }
+
+    init_model(feed);
+    if (optind == argc)
+        estimate_stream(&est, stdin, "<stdin>");
+    for (int i = optind; i < argc; i++) {
+        FILE *in = fopen(argv[i], "r");
+        if (!in) {
+            fprintf(stderr, "estimate: %s: %s\n", argv[i], strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        estimate_stream(&est, in, argv[i]);
+        fclose(in);
+    }
+    print_report(&est);
+    return est.e_errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,22 @@
+#ifndef PGMSPACE_included
+#define PGMSPACE_included
+
+// Host stand-in for avr-libc's <avr/pgmspace.h>.  On the host,
+// program memory is ordinary memory.
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PGM_P                 const char *
+#define PSTR(s)               (s)
+
+#define pgm_read_byte(addr)   (*(const uint8_t  *)(addr))
+#define pgm_read_word(addr)   (*(const uint16_t *)(addr))
+#define pgm_read_dword(addr)  (*(const uint32_t *)(addr))
+
+#define memcpy_P              memcpy
+#define strlen_P              strlen
+#define strncpy_P             strncpy
+
+#endif /* !PGMSPACE_included */
@@ -0,0 +1,10 @@
+#ifndef ATOMIC_included
+#define ATOMIC_included
+
+// Host stand-in for avr-libc's <util/atomic.h>.  The estimator has
+// no interrupts, so an atomic block just runs its body once.
+
+#define ATOMIC_BLOCK(type) for (int atomic_once_ = 1; atomic_once_; \
+                                atomic_once_ = 0)
+
+#endif /* !ATOMIC_included */
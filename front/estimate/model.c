@@ -0,0 +1,361 @@
+#include "model.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "back/atoms.h"
+#include "back/fault.h"
+#include "back/fw_assert.h"
+#include "back/variables.h"
+
+// The model includes back/scheduler.c itself, so the estimate follows
+// every subdivision and rounding the back end makes.  The scheduler
+// reaches the timer queues and the engine through queues.h and
+// engine.h.  Those are AVR-specific, so their include guards are
+// defined here, and the definitions below stand in for them.
+
+#define QUEUES_included
+#define ENGINE_included
+
+// A queue holds as many atoms as the back end's, so the scheduler
+// splits its work into the same rounds.
+
+#define QUEUE_SIZE 127
+
+typedef struct queue {
+    uint16_t q_atoms[QUEUE_SIZE];
+    uint8_t  q_length;
+    bool     q_stepping;        // motor step enabled
+    uint64_t q_ticks;           // time of the atoms executed
+    uint64_t q_count;           // atoms enqueued
+} queue;
+
+static queue Xq, Yq, Zq, Pq;
+
+static inline uint8_t queue_available(const queue *q)
+{
+    return QUEUE_SIZE - q->q_length;
+}
+
+static inline void enqueue_atom(uint16_t a, queue *q)
+{
+    fw_assert(q->q_length < QUEUE_SIZE);
+    q->q_atoms[q->q_length++] = a;
+    q->q_count++;
+}
+
+extern void start_engine(void);
+extern void stop_engine_immediately(void);
+extern void await_engine_stopped(void);
+
+#include "back/scheduler.c"
+
+struct fault_private fault_private;
+
+const uint16_t model_min_interval = MIN_IVL;
+
+static atom      laser_atom;
+static uint64_t  main_laser_ticks;
+static uint64_t  visible_laser_ticks;
+static uint16_t  min_step;
+static uint32_t  home_count;
+static uint32_t  segment_count;
+
+// Atoms executed in each window of machine time.
+static uint32_t *window_atoms;
+static size_t    window_count;
+
+void fw_assertion_failed(unsigned int line_no)
+{
+    fprintf(stderr, "estimate: back end assertion failed at "
+                    "scheduler.c or variables.c line %u\n", line_no);
+    exit(EXIT_FAILURE);
+}
+
+static void count_atom(uint64_t ticks)
+{
+    size_t w = ticks / MODEL_WINDOW_TICKS;
+    if (w >= window_count) {
+        size_t count = window_count ? window_count : 1024;
+        while (count <= w)
+            count *= 2;
+        uint32_t *p = realloc(window_atoms, count * sizeof *p);
+        if (!p) {
+            perror("estimate");
+            exit(EXIT_FAILURE);
+        }
+        memset(p + window_count, 0,
+               (count - window_count) * sizeof *p);
+        window_atoms = p;
+        window_count = count;
+    }
+    window_atoms[w]++;
+}
+
+static inline bool laser_is_on(atom a, atom on, atom stop)
+{
+    return a == on || a == stop;
+}
+
+// Execute a queue's atoms, as the engine's timer interrupts would.
+// The homing rewinds depend on the limit switches, so each homing
+// stroke is counted once.
+static void drain_queue(queue *q, bool is_motor)
+{
+    for (uint8_t i = 0; i < q->q_length; i++) {
+        uint16_t a = q->q_atoms[i];
+        count_atom(q->q_ticks);
+        if (is_atom(a)) {
+            switch (a) {
+
+            case A_REWIND_IF_MIN:
+            case A_REWIND_UNLESS_MIN:
+            case A_REWIND_IF_MAX:
+            case A_REWIND_UNLESS_MAX:
+            case A_SEGMENT_END:
+                count_atom(q->q_ticks); // the count or segment number
+                i++;
+                break;
+
+            case A_ENABLE_STEP:
+                q->q_stepping = true;
+                break;
+
+            case A_DISABLE_STEP:
+                q->q_stepping = false;
+                break;
+
+            case A_LASERS_OFF:
+            case A_MAIN_LASER_OFF:
+            case A_MAIN_LASER_ON:
+            case A_MAIN_LASER_START:
+            case A_MAIN_LASER_STOP:
+            case A_VISIBLE_LASER_OFF:
+            case A_VISIBLE_LASER_ON:
+            case A_VISIBLE_LASER_START:
+            case A_VISIBLE_LASER_STOP:
+                laser_atom = a;
+                break;
+            }
+            continue;
+        }
+        q->q_ticks += a;
+        if (is_motor) {
+            if (q->q_stepping && (!min_step || min_step > a))
+                min_step = a;
+        } else if (laser_is_on(laser_atom,
+                               A_MAIN_LASER_ON, A_MAIN_LASER_STOP))
+            main_laser_ticks += a;
+        else if (laser_is_on(laser_atom,
+                             A_VISIBLE_LASER_ON, A_VISIBLE_LASER_STOP))
+            visible_laser_ticks += a;
+    }
+    q->q_length = 0;
+}
+
+void start_engine(void)
+{
+    drain_queue(&Xq, true);
+    drain_queue(&Yq, true);
+    drain_queue(&Zq, true);
+    drain_queue(&Pq, false);
+}
+
+void stop_engine_immediately(void)
+{
+    Xq.q_length = Yq.q_length = Zq.q_length = Pq.q_length = 0;
+    laser_atom = A_LASERS_OFF;
+}
+
+void await_engine_stopped(void)
+{
+    // The queues are always empty.
+}
+
+// The back end would divide by zero, loop forever, or step too fast
+// to interrupt on some parameters.  Reject those before scheduling.
+static const char *check_segment(uint8_t cmd)
+{
+    int32_t     xd = 0, yd = 0, zd = 0;
+    if (cmd != 'd') {
+        xd = get_signed_variable(V_XD);
+        yd = get_signed_variable(V_YD);
+        zd = get_signed_variable(V_ZD);
+    }
+    uint_fast24 md = major_distance(xd, yd, zd);
+    uint32_t    mt = get_unsigned_variable(V_MT);
+    if (cmd != 'd')
+        mt = override_move_time(mt, md);
+    if (mt == 0)
+        return "move time is zero";
+    if (md && mt / md < ATOM_MAX)
+        return "steps are too fast to schedule";
+
+    uint8_t ls = cmd == 'm' ? 'n' : get_enum_variable(V_LS);
+    uint8_t pm = get_enum_variable(V_PM);
+    if (lasers_are_inactive(ls, pm, md) || pm == 'c')
+        return NULL;
+    uint32_t pw = get_unsigned_variable(V_PW);
+    uint32_t pi;
+    if (pm == 't')
+        pi = get_unsigned_variable(V_PI);
+    else {
+        uint32_t pd = get_unsigned_variable(V_PD);
+        if (pd == 0 || md / pd == 0)
+            return "cut is shorter than one pulse distance";
+        pi = mt / (md / pd);
+    }
+    if (pi == 0 || pi < pw)
+        return "pulse interval is shorter than the pulse width";
+    return NULL;
+}
+
+static model_line parse_assignment(const char *line, const char **errp)
+{
+    v_name name = { line[0], line[1], '\0' };
+    v_index index = lookup_variable(name);
+    if (line[1] == '\0' || line[2] != '=' || index == VAR_NOT_FOUND) {
+        *errp = "unknown variable";
+        return ML_ERROR;
+    }
+    const char *p = line + 3;
+    v_value value;
+    bool is_negative = false;
+    switch (get_variable_type(index)) {
+
+    case VT_SIGNED:
+        if (*p == '-')
+            is_negative = true;
+        else if (*p != '+') {
+            *errp = "signed value needs a sign";
+            return ML_ERROR;
+        }
+        p++;
+        // Fall through.
+
+    case VT_UNSIGNED:
+        {
+            uint32_t n = 0;
+            while (*p >= '0' && *p <= '9')
+                n = 10 * n + (*p++ - '0');
+            if (is_negative)
+                value.vv_signed = -(int32_t)n;
+            else
+                value.vv_unsigned = n;
+        }
+        break;
+
+    case VT_ENUM:
+        if (!*p || !variable_enum_is_OK(index, *p)) {
+            *errp = "bad enumeration value";
+            return ML_ERROR;
+        }
+        value.vv_enum = *p++;
+        break;
+
+    default:
+        fw_assert(false);
+    }
+    if (*p) {
+        *errp = "syntax error";
+        return ML_ERROR;
+    }
+    set_variable(index, value);
+    return ML_ASSIGNMENT;
+}
+
+static model_line parse_command(const char *line, const char **errp)
+{
+    if (line[0] == 'W' && line[1] == '\0') {
+        await_completion();
+        return ML_WAIT;
+    }
+    if (line[0] != 'Q')
+        return ML_OTHER;
+    uint8_t cmd = line[1];
+    if (cmd == '\0' || line[2] != '\0') {
+        *errp = "unknown command";
+        return ML_ERROR;
+    }
+    if (cmd == 'h') {
+        enqueue_home();
+        home_count++;
+        // The homing strokes' time is unknown.  Restart the motor
+        // queues' clocks in step with the laser queue.
+        Xq.q_ticks = Yq.q_ticks = Zq.q_ticks = Pq.q_ticks;
+        return ML_HOME;
+    }
+    if (cmd == 'e') {
+        *errp = "the back end does not implement engraving";
+        return ML_ERROR;
+    }
+    if (cmd != 'c' && cmd != 'd' && cmd != 'm') {
+        *errp = "unknown command";
+        return ML_ERROR;
+    }
+    *errp = check_segment(cmd);
+    if (*errp)
+        return ML_ERROR;
+    min_step = 0;
+    if (cmd == 'c')
+        enqueue_cut();
+    else if (cmd == 'd')
+        enqueue_dwell();
+    else
+        enqueue_move();
+    segment_count++;
+    return ML_SEGMENT;
+}
+
+void init_model(uint8_t feed_override)
+{
+    init_variables();
+    init_scheduler();
+    stop_engine_immediately();
+    adjust_feed_override_NONATOMIC(0);
+    adjust_feed_override_NONATOMIC(feed_override - 100);
+}
+
+model_line model_execute(const char *line, const char **errp)
+{
+    *errp = NULL;
+    if (line[0] == '\0')
+        return ML_BLANK;
+    if (line[0] >= 'a' && line[0] <= 'z')
+        return parse_assignment(line, errp);
+    if (line[0] >= 'A' && line[0] <= 'Z')
+        return parse_command(line, errp);
+    *errp = "syntax error";
+    return ML_ERROR;
+}
+
+uint64_t model_ticks(void)
+{
+    return Pq.q_ticks;
+}
+
+uint16_t model_min_step(void)
+{
+    return min_step;
+}
+
+void model_get_stats(model_stats *sp)
+{
+    memset(sp, 0, sizeof *sp);
+    sp->ms_ticks               = Pq.q_ticks;
+    sp->ms_main_laser_ticks    = main_laser_ticks;
+    sp->ms_visible_laser_ticks = visible_laser_ticks;
+    sp->ms_atoms[MQ_X]         = Xq.q_count;
+    sp->ms_atoms[MQ_Y]         = Yq.q_count;
+    sp->ms_atoms[MQ_Z]         = Zq.q_count;
+    sp->ms_atoms[MQ_P]         = Pq.q_count;
+    sp->ms_segments            = segment_count;
+    sp->ms_homes               = home_count;
+    for (size_t w = 0; w < window_count; w++)
+        if (sp->ms_peak_atoms < window_atoms[w]) {
+            sp->ms_peak_atoms = window_atoms[w];
+            sp->ms_peak_ticks = (uint64_t)w * MODEL_WINDOW_TICKS;
+        }
+}
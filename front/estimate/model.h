@@ -0,0 +1,59 @@
+#ifndef MODEL_included
+#define MODEL_included
+
+#include <stdint.h>
+
+// The model runs the back end's scheduler, compiled for the host, on
+// S-code lines.  Where the back end's engine would execute the timer
+// queues in real time, the model drains them at once and adds up the
+// time their atoms would take.  Times are in timer ticks, F_CPU per
+// second.
+
+#define MODEL_WINDOW_TICKS (F_CPU / 100) // atom rate window, 10 ms
+
+typedef enum model_queue {
+    MQ_X,
+    MQ_Y,
+    MQ_Z,
+    MQ_P,
+    MQ_COUNT
+} model_queue;
+
+typedef enum model_line {
+    ML_BLANK,                   // empty line
+    ML_ASSIGNMENT,              // variable assignment
+    ML_SEGMENT,                 // enqueue command: dwell, move or cut
+    ML_HOME,                    // enqueue home; its time is unknown
+    ML_WAIT,                    // wait for the queues to empty
+    ML_OTHER,                   // command that takes no machine time
+    ML_ERROR,                   // the back end would reject the line
+} model_line;
+
+typedef struct model_stats {
+    uint64_t ms_ticks;                  // machine time
+    uint64_t ms_main_laser_ticks;       // main laser on
+    uint64_t ms_visible_laser_ticks;    // visible laser on
+    uint64_t ms_atoms[MQ_COUNT];        // atoms generated per queue
+    uint32_t ms_peak_atoms;             // most atoms in one window
+    uint64_t ms_peak_ticks;             // start of that window
+    uint32_t ms_segments;
+    uint32_t ms_homes;
+} model_stats;
+
+extern void       init_model      (uint8_t feed_override);
+
+// Execute one line, without its newline.  On ML_ERROR, *errp points
+// to a description.
+extern model_line model_execute   (const char *line, const char **errp);
+
+// Machine time so far, and the shortest motor step interval in the
+// last segment, or 0 if no motor stepped.  The engine can't step
+// faster than model_min_interval.
+extern uint64_t   model_ticks     (void);
+extern uint16_t   model_min_step  (void);
+
+extern const uint16_t model_min_interval;
+
+extern void       model_get_stats (model_stats *);
+
+#endif /* !MODEL_included */
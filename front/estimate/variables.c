@@ -0,0 +1,3 @@
+// The back end's variables, compiled for the host.
+
+#include "back/variables.c"
@@ -1,9 +1,12 @@
 """Kerfburn G-Code Interpreter"""
 
+from gcode.batch import BatchExecutor
 from gcode.core import GCodeException, SourceLine
 from gcode.interpreter import Interpreter
 from gcode.laser import LaserExecutor
+from gcode.order import TravelOrderExecutor
 from gcode.parser import GCodeSyntaxError
+from gcode.simplify import SimplifyExecutor
 # from gcode.shell import Shell, shell
 
 
@@ -12,9 +15,12 @@ from gcode.parser import GCodeSyntaxError
 GCodeException.__module__ = 'gcode'
 
 
-__all__ = ['GCodeException',
+__all__ = ['BatchExecutor',
+           'GCodeException',
            'GCodeSyntaxError',
            'Interpreter',
            'LaserExecutor',
+           'SimplifyExecutor',
            'SourceLine',
+           'TravelOrderExecutor',
            ]
@@ -0,0 +1,119 @@
+"""Batch motion: translate a block of moves at once"""
+
+from collections import namedtuple
+from math import sqrt
+import sys
+
+from gcode.laser import LaserExecutor
+
+
+# A raster job is mostly short moves, often with a power change per
+# move, and translating one move at a time spends most of its time in
+# method calls: move_to(), four or five assign()s and an emit() per
+# move, and a print per S-code line.  BatchExecutor holds a block of
+# moves and assignments instead.  It computes every move's deltas,
+# distance, major distance and move time in one pass over lists,
+# formats the block's S-code into one string and writes it once.
+#
+# The values are computed exactly as LaserExecutor.move_to() computes
+# them, in the same order, and LaserExecutor's own assignment() and
+# model_link() elide, format and account for each line, so the S-code
+# and the link report are the same as unbatched.  A block ends at any
+# other command, and after BATCH_SIZE items, so S-code is never held
+# long.
+
+BATCH_SIZE = 256
+
+
+def segments(head, targets, ivls):
+
+    """Return (deltas, distances, major distances, move times)."""
+
+    starts = [head] + targets[:-1]
+    deltas = [(t[0] - s[0], t[1] - s[1], t[2] - s[2])
+              for (s, t) in zip(starts, targets)]
+    ds = [sqrt(xd**2 + yd**2 + zd**2) for (xd, yd, zd) in deltas]
+    mds = [max(abs(xd), abs(yd), abs(zd)) for (xd, yd, zd) in deltas]
+    mts = [int(d * ivl) for (d, ivl) in zip(ds, ivls)]
+    return (deltas, ds, mds, mts)
+
+
+Move = namedtuple('Move', 'target ivl pulse_distance pos cmd')
+
+
+class BatchExecutor(LaserExecutor):
+
+    """LaserExecutor that translates moves in blocks"""
+
+    def __init__(self):
+        super(BatchExecutor, self).__init__()
+        self.block = []         # moves and (name, value) assignments
+        self.start = None       # where the head was before the block
+
+    def traverse(self, target):
+        self.hold(target, self.traverse_ivl_native, None, 'Qm')
+
+    def cut(self, target, ivl, pulse_distance=None):
+        self.hold(target, ivl, pulse_distance, 'Qc')
+
+    # self.head moves as each move is held, so the stages above see
+    # where the head will be.
+
+    def hold(self, target, ivl, pulse_distance, cmd):
+        self.hold_item(Move(target, ivl, pulse_distance, self.pos, cmd))
+        self.head = target
+
+    def assign(self, name, value):
+        self.hold_item((name, value))
+
+    def hold_item(self, item):
+        if not self.block:
+            self.start = self.head
+        self.block.append(item)
+        if len(self.block) >= BATCH_SIZE:
+            self.flush_block()
+
+    def emit(self, *cmds):
+        self.flush_block()
+        super(BatchExecutor, self).emit(*cmds)
+
+    def flush_block(self):
+        block, self.block = self.block, []
+        if not block:
+            return
+        moves = [item for item in block if isinstance(item, Move)]
+        (deltas, ds, mds, mts) = segments(self.start,
+                                          [m.target for m in moves],
+                                          [m.ivl for m in moves])
+        out = []
+
+        def put(cmd):
+            if cmd:
+                out.append(cmd)
+                self.model_link(cmd)
+
+        # Assignments are elided against the firmware's values, and pd
+        # is chosen from them, so those stay one item at a time.  Each
+        # move is reported at its own line.
+        line_pos = self.pos
+        i = 0
+        for item in block:
+            if not isinstance(item, Move):
+                put(self.assignment(*item))
+                continue
+            for (name, value) in zip(('xd', 'yd', 'zd'), deltas[i]):
+                put(self.assignment(name, value))
+            put(self.assignment('mt', mts[i]))
+            if item.pulse_distance and mds[i]:
+                pd = self.choose_pd(ds[i], mds[i], item.pulse_distance)
+                put(self.assignment('pd', pd))
+            self.pos = item.pos
+            put(item.cmd)
+            i += 1
+        self.pos = line_pos
+        out.append('')
+        sys.stdout.write('\n'.join(out))
+
+    def finish(self):
+        self.flush_block()
+        super(BatchExecutor, self).finish()
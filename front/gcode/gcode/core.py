@@ -7,6 +7,7 @@ from functools import wraps
 import inspect
 import math
 import numbers
+import operator
 from collections import namedtuple
 import cPickle as pickle
 import string
@@ -119,6 +120,8 @@ class LanguageCode(str):
         ds = s.defaults
         if ds:
             instance.default_args.update(zip(s.args[-len(ds):], ds))
+        instance.arg_letters = tuple(a for a in s.args
+                                     if len(a) == 1 and a in string.uppercase)
         return instance
 
     def __repr__(self):
@@ -127,11 +130,6 @@ class LanguageCode(str):
     def matches(self, letter, number):
         return self.letter == letter and self.number == number
 
-    @property
-    def arg_letters(self):
-        args = inspect.getargspec(self.func).args
-        return tuple(a for a in args if len(a) == 1 and a in string.uppercase)
-
 
 class ModalGroup(str):
 
@@ -322,6 +320,65 @@ class Dialect(namedtuple('Dialect', 'modal_groups nonmodal_groups')):
     def passive_code_letters(self):
         return self.arg_letters
 
+    def compile(self, order_of_execution):
+        return CompiledDialect(self, order_of_execution)
+
+
+# A CompiledDialect numbers a dialect's codes and groups, so the
+# interpreter can check a line's words with integer and bitmask
+# operations.  Codes are numbered in active_codes order, groups in
+# order of execution.  Argument letters are bits, A = 1 << 0.
+#
+#   code_table      {(letter, round(10 * number)): code index}
+#   codes           [LanguageCode]
+#   code_group      [group index]
+#   code_args       [argument letter bitmask]
+#   code_require    [require_any bitmask, or 0]
+#   groups          [group]
+#   letter_bits     {passive letter: bit}
+
+def letter_bit(letter):
+    return 1 << (ord(letter) - ord('A'))
+
+def letter_mask(letters):
+    return reduce(operator.or_, (letter_bit(a) for a in letters or ()), 0)
+
+
+class CompiledDialect(object):
+
+    def __init__(self, dialect, order_of_execution):
+        groups = {str(g): g for g in dialect.groups}
+        self.groups = [groups[op]
+                       for op in order_of_execution
+                       if not inspect.ismethod(op)]
+        group_index = {g: i for (i, g) in enumerate(self.groups)}
+        self.codes = list(dialect.active_codes)
+        self.code_table = {}
+        for (i, c) in enumerate(self.codes):
+            key = (c.letter, int(round(10 * c.number)))
+            assert key not in self.code_table, 'codes %s and %s collide' % (
+                c, self.codes[self.code_table[key]])
+            self.code_table[key] = i
+        self.code_group = [group_index[c.group] for c in self.codes]
+        self.code_args = [letter_mask(c.arg_letters) for c in self.codes]
+        self.code_require = [letter_mask(c.require_any) for c in self.codes]
+        self.letter_bits = {a: letter_bit(a)
+                            for a in dialect.passive_code_letters}
+        self.dialect = dialect
+
+    def find_active_code(self, letter, number):
+
+        """Return the index of the code, or None."""
+
+        # A number within 0.0001 of a code's number matches it.  That
+        # nearly always rounds to the code's key; search if not.
+        i = self.code_table.get((letter, int(round(10 * number))))
+        if i is not None and self.codes[i].number == number:
+            return i
+        code = self.dialect.find_active_code(letter, number)
+        if code is not None:
+            return self.codes.index(code)
+
 
 class Executor(object):
 
@@ -15,7 +15,47 @@ class Interpreter(object):
         self.parameters = core.ParameterSet()
         self.settings = executor.initial_settings
         self.parser = parser.Parser(self.parameters, executor.dialect)
-        self.modes = dict.fromkeys(executor.dialect.modal_groups)
+        self.compile()
+
+    def compile(self):
+
+        # The dialect and the order of execution are fixed, so look up
+        # everything execute() needs once.  Each step of execution is
+        # (method, group index, group, prepare method, finish method).
+        # A step has a method or a group, not both.  Codes are handled
+        # by their index in cd.codes, and each group's mode is the
+        # index of its current code.
+
+        executor = self.executor
+        ooe = executor.order_of_execution
+        self.compiled = cd = executor.dialect.compile(ooe)
+        self.steps = []
+        gi = 0
+        for op in ooe:
+            if inspect.ismethod(op):
+                self.steps.append((op, None, None, None, None))
+                continue
+            group = cd.groups[gi]
+            prepare = finish = None
+            if group.prepare_func:
+                prepare = getattr(executor, group.prepare_func.func_name)
+            if group.finish_func:
+                finish = getattr(executor, group.finish_func.func_name)
+            self.steps.append((None, gi, group, prepare, finish))
+            gi += 1
+        self.modes = [None] * len(cd.groups)
+
+        # A handler is (method, code, argument letters, default
+        # arguments).  A code method's arguments are its letters, in
+        # order, so it is called with them positionally.
+        self.handlers = []
+        for code in cd.codes:
+            method = getattr(executor, code)
+            args = tuple(inspect.getargspec(method).args[1:])
+            assert args == code.arg_letters, '%s takes non-letters' % code
+            self.handlers.append((method, code, code.arg_letters,
+                                  code.default_args))
+        self.code_index = {code: i for (i, code) in enumerate(cd.codes)}
 
     def interpret_line(self, line, source=None, lineno=None):
 
@@ -46,86 +86,111 @@ class Interpreter(object):
                 raise core.GCodeException('unknown action: %r' % (action,))
 
     def prep_words(self, pline):
-        active_groups = {}
-        active_args = {}
-        dialect = self.executor.dialect
+
+        """Return the line's code indices by group, and its settings."""
+
+        cd = self.compiled
+        letter_bits = cd.letter_bits
         new_settings = {}
-        modal_groups = {}
+        arg_mask = 0
         codes = []
         for (letter, number) in pline.words:
-            if letter in dialect.passive_code_letters:
+            bit = letter_bits.get(letter)
+            if bit:
                 new_settings[letter] = number
+                arg_mask |= bit
             else:
-                code = dialect.find_active_code(letter, number)
-                if code is None:
+                i = cd.find_active_code(letter, number)
+                if i is None:
                     msg = 'unknown code %s%s' % (letter, number)
                     raise parser.GCodeSyntaxError(pline.source.pos, msg)
-                codes.append(code)
-        for code in codes:
-            group = code.group
-            if group:
-                if group in active_groups:
-                    prev = active_groups[group]
-                    msg = '%s conflicts with %s' % (code, prev)
-                    raise parser.GCodeSyntaxError(pline.source.pos, msg)
-                active_groups[group] = code
-            for arg in code.arg_letters:
-                if arg in new_settings:
-                    if arg in active_args:
-                        msg = '%s%s ambiguous between %s and %s'
-                        msg %= (arg, new_settings[arg], active_args[arg], code)
-                        raise parser.GCodeSyntaxError(pline.source.pos, msg)
-                    active_args[arg] = code
-            r_any = code.require_any
-            if r_any and not any(a in new_settings for a in r_any):
+                codes.append(i)
+        active = [None] * len(cd.groups)
+        claimed = 0
+        for i in codes:
+            code = cd.codes[i]
+            gi = cd.code_group[i]
+            if active[gi] is not None:
+                msg = '%s conflicts with %s' % (code, cd.codes[active[gi]])
+                raise parser.GCodeSyntaxError(pline.source.pos, msg)
+            active[gi] = i
+            args = cd.code_args[i] & arg_mask
+            if args & claimed:
+                self.ambiguous_arg(pline, codes, new_settings, i)
+            claimed |= args
+            r_any = cd.code_require[i]
+            if r_any and not r_any & arg_mask:
                 msg = 'code %s requires at least one of %s'
-                msg %= (code, ', '.join(r_any))
+                msg %= (code, ', '.join(code.require_any))
                 raise parser.GCodeSyntaxError(pline.source.pos, msg)
 
-        return active_groups, new_settings
+        return active, new_settings
+
+    def ambiguous_arg(self, pline, codes, new_settings, i):
+        cd = self.compiled
+        code = cd.codes[i]
+        prevs = [cd.codes[j] for j in codes[:codes.index(i)]]
+        for arg in code.arg_letters:
+            for prev in prevs:
+                if arg in new_settings and arg in prev.arg_letters:
+                    msg = '%s%s ambiguous between %s and %s'
+                    msg %= (arg, new_settings[arg], prev, code)
+                    raise parser.GCodeSyntaxError(pline.source.pos, msg)
 
     def execute(self, pline):
-        dialect = self.executor.dialect
-        active_groups, new_settings = self.prep_words(pline)
-        self.settings.update(new_settings)
-        for op in self.executor.order_of_execution:
+        active, new_settings = self.prep_words(pline)
+        settings = self.settings
+        settings.update(new_settings)
+        modes = self.modes
+        for (method, gi, group, prepare, finish) in self.steps:
             action = None
-            if inspect.ismethod(op):
-                action = op(self.settings, new_settings, pline)
+            if method:
+                action = method(settings, new_settings, pline)
             else:
-                assert isinstance(op, str)
-                group = dialect.find_group(op)
-                active_code = active_groups.get(op)
-                if group.prepare_func:
-                    method = getattr(self.executor,
-                                     group.prepare_func.func_name)
-                    active_code = method(mode=self.modes[group],
-                                         new_mode=active_code,
-                                         settings=self.settings,
-                                         new_settings=new_settings)
-                if active_code:
-                    self.modes[op] = active_code
-                    action = self.call_code(active_code)
-                if group.finish_func:
-                    method = getattr(self.executor, group.finish_func.func_name)
-                    method(mode=self.modes[group],
-                           new_mode=active_code,
-                           settings=self.settings,
+                i = active[gi]
+                if prepare:
+                    i = self.prepare(prepare, modes[gi], i,
+                                     settings, new_settings)
+                if i is not None:
+                    modes[gi] = i
+                    action = self.call_code(i)
+                if finish:
+                    finish(mode=self.code(modes[gi]),
+                           new_mode=self.code(i),
+                           settings=settings,
                            new_settings=new_settings)
             if action is not None:
                 return action
 
-    def call_code(self, code):
-
-        def get_val(arg):
-            val = self.settings[arg]
+    def code(self, i):
+        return None if i is None else self.compiled.codes[i]
+
+    def prepare(self, prepare, mode, new_mode, settings, new_settings):
+
+        """Call a group's prepare method, which takes and returns codes."""
+
+        mode_code = self.code(mode)
+        new_code = self.code(new_mode)
+        code = prepare(mode=mode_code,
+                       new_mode=new_code,
+                       settings=settings,
+                       new_settings=new_settings)
+        if code is new_code:
+            return new_mode
+        if code is mode_code:
+            return mode
+        return self.code_index[code]
+
+    def call_code(self, i):
+        (method, code, arg_letters, default_args) = self.handlers[i]
+        settings = self.settings
+        args = []
+        for a in arg_letters:
+            val = settings[a]
             if val is None:
-                if arg in code.default_args:
-                    return code.default_args[arg]
-                msg = '%s requires a %s code' % (code, arg)
-                raise core.GCodeException(msg)
-            return val
-
-        args = {a: get_val(a) for a in code.arg_letters}
-        method = getattr(self.executor, code)
-        return method(**args)
+                if a not in default_args:
+                    msg = '%s requires a %s code' % (code, a)
+                    raise core.GCodeException(msg)
+                val = default_args[a]
+            args.append(val)
+        return method(*args)
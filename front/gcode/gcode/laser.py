@@ -7,8 +7,10 @@ from gcode.arc import XYArcMixin
 from gcode.core import ApproximateNumber, CheapEnum, Executor, GCodeException
 from gcode.core import code, group_prepare, group_finish
 from gcode.core import modal_group, nonmodal_group
+from gcode.link import LinkModel
 from gcode.motion import DistanceMode, DistanceUnits
 from gcode.parser import parse_comment
+from gcode import proto_defs
 
 
 F_CPU = 16000000                # CPU frequency - should come from config.
@@ -19,35 +21,32 @@ Y_USTEPS_PER_INCH = 2000
 Z_USTEPS_PER_INCH = 20825
 
 
-class Animation(CheapEnum):
-    startup = 's'
-    complete = 'c'
-    warning = 'w'
-    alert = 'a'
-    none = 'n'
-    _map = {
-        0: none,
-        1: startup,
-        2: complete,
-        3: warning,
-        4: alert,
-        }
-
-class LaserSelect(CheapEnum):
-    none = 'n'
-    main = 'm'
-    visible = 'v'
-    _map = {
-        0: none,
-        1: main,
-        2: visible,
-        }
-
-class PulseMode(CheapEnum):
-    continuous = 'c'
-    timed = 't'
-    distance = 'd'
-    off = 'o'
+# The firmware's enumerated variables.  Member names and codes come
+# from the protocol definition, config/protocol.py.
+
+proto_vars = {v.name: v for v in proto_defs.variables}
+
+def proto_enum(name, var):
+    members = {e.name: e.code for e in proto_vars[var].values}
+    return type(name, (CheapEnum,), members)
+
+Animation = proto_enum('Animation', 'ia')
+Animation._map = {
+    0: Animation.none,
+    1: Animation.startup,
+    2: Animation.complete,
+    3: Animation.warning,
+    4: Animation.alert,
+    }
+
+LaserSelect = proto_enum('LaserSelect', 'ls')
+LaserSelect._map = {
+    0: LaserSelect.none,
+    1: LaserSelect.main,
+    2: LaserSelect.visible,
+    }
+
+PulseMode = proto_enum('PulseMode', 'pm')
 
 
 class AxisPosition(object):
@@ -87,6 +86,11 @@ class LaserExecutor(Executor, XYArcMixin):
         self.traverse_ivl_native = self.native_ivl(TRAVERSE_RATE)
         self.feed_ivl_native = self.native_ivl(DEFAULT_FEED_RATE)
         self.pulse_mode = PulseMode.off
+        self.head = (0, 0, 0)
+        self.origin = (0, 0, 0)
+        self.fw_vars = {}
+        self.link = LinkModel()
+        self.pos = None
 
     @property
     def initial_settings(self):
@@ -129,6 +133,7 @@ class LaserExecutor(Executor, XYArcMixin):
 
     def exec_begin_line(self, settings, new_settings, pline):
         self.line_already_used_axes = False
+        self.pos = pline.source.pos
 
     def exec_comment(self, settings, new_settings, pline):
         if pline.comment:
@@ -145,8 +150,7 @@ class LaserExecutor(Executor, XYArcMixin):
 
             """traverse move, laser off"""
 
-            self.do_motion(X, Y, Z, self.traverse_ivl_native)
-            self.emit('Qm')
+            self.traverse(self.do_motion(X, Y, Z))
 
         @code(require_any='XYZ')
         def G1(self, X=None, Y=None, Z=None, F=None):
@@ -157,11 +161,12 @@ class LaserExecutor(Executor, XYArcMixin):
                 # N.B., F is units per MINUTE.
                 ivl = self.native_ivl(float(F) / 60, self.distance_units)
                 self.feed_ivl_native = ivl
-            d = self.do_motion(X, Y, Z, self.feed_ivl_native)
+            pulse_distance = None
             if self.pulse_mode == PulseMode.distance:
-                pd = int(round(d / self.pulse_distance_usteps))
-                self.emit('pd=%d' % pd)
-            self.emit('Qc')
+                pulse_distance = self.pulse_distance_usteps
+            self.cut(self.do_motion(X, Y, Z),
+                     self.feed_ivl_native,
+                     pulse_distance)
 
         @group_prepare
         def prepare_motion(self, mode, new_mode, settings, new_settings):
@@ -202,8 +207,8 @@ class LaserExecutor(Executor, XYArcMixin):
 
         """dwell"""
 
-        mt = self.secs_to_ticks(P)
-        self.emit('mt=%d' % mt, 'Qd')
+        self.assign('mt', self.secs_to_ticks(P))
+        self.emit('Qd')
 
     @code(modal_group='plane selection')
     def G17(self):
@@ -247,6 +252,7 @@ class LaserExecutor(Executor, XYArcMixin):
         self.y_pos.reset()
         self.z_pos.reset()
         self.emit('Qh', 'W')
+        self.head = (0, 0, 0)
 
     with modal_group('distance mode'):
 
@@ -295,7 +301,7 @@ class LaserExecutor(Executor, XYArcMixin):
         ls = self.get_enum('M6', 'T', LaserSelect, T)
         if ls is not None:
             self.laser_select = ls
-            self.emit('ls=%s' % ls)
+            self.assign('ls', ls)
 
     with modal_group('motors'):
 
@@ -336,12 +342,11 @@ class LaserExecutor(Executor, XYArcMixin):
 
         self.laser_power = P
         lp = max(0, min(4095, int(4095 * P)))
-        self.emit('lp=%d' % lp)
+        self.assign('lp', lp)
 
     @code(modal_group='laser pulse width')
     def M101(self, P):
-        pw = self.secs_to_ticks(P)
-        self.emit('pw=%d' % pw)
+        self.assign('pw', self.secs_to_ticks(P))
 
     with modal_group('high voltage'):
 
@@ -398,7 +403,7 @@ class LaserExecutor(Executor, XYArcMixin):
 
             """set laser pulse mode to continuous fire"""
 
-            self.emit('pm=c')
+            self.assign('pm', PulseMode.continuous)
             self.pulse_mode = PulseMode.continuous
 
         @code
@@ -407,8 +412,8 @@ class LaserExecutor(Executor, XYArcMixin):
             """set laser pulse mode to timed"""
 
             self.pulse_mode = PulseMode.timed
-            pi = self.secs_to_ticks(S)
-            self.emit('pm=t', 'pi=%d' % pi)
+            self.assign('pm', PulseMode.timed)
+            self.assign('pi', self.secs_to_ticks(S))
 
         @code
         def M110(self, S):
@@ -421,14 +426,14 @@ class LaserExecutor(Executor, XYArcMixin):
                  self.x_pos.units_to_usteps(S,
                                             self.distance_units,
                                             integer=False))
-            self.emit('pm=d')
+            self.assign('pm', PulseMode.distance)
 
         @code
         def M111(self):
 
             """set laser pulse mode to off"""
 
-            self.emit('pm=o')
+            self.assign('pm', PulseMode.off)
             self.pulse_mode = PulseMode.off
 
     @code(nonmodal_group='emergency stop')
@@ -447,32 +452,55 @@ class LaserExecutor(Executor, XYArcMixin):
             """set illumination level"""
 
             il = max(0, min(127, int(P * 127)))
-            self.emit('il=%d' % il)
+            self.assign('il', il)
 
         @code
         def M114(self, P):
             ia = self.get_enum('M114', 'P', Animation, P)
             if ia is not None:
                 self.animation = ia
-                self.emit('ia=%s' % ia)
+                self.assign('ia', ia)
 
     # #  #    #    #     #      #       #      #     #    #   #  # #
 
-    def do_motion(self, X, Y, Z, ivl):
-        xd = self.update_pos(self.x_pos, X)
-        yd = self.update_pos(self.y_pos, Y)
-        zd = self.update_pos(self.z_pos, Z)
+    # do_motion() returns the target position in microsteps and sets
+    # self.origin to where the G-code moves from.  The head moves
+    # there when traverse() or cut() emits the move.  Between them, a
+    # subclass may hold moves back, reorder them or merge them.
+
+    def do_motion(self, X, Y, Z):
+        self.origin = (self.x_pos.pos_usteps,
+                       self.y_pos.pos_usteps,
+                       self.z_pos.pos_usteps)
+        return (self.update_pos(self.x_pos, X),
+                self.update_pos(self.y_pos, Y),
+                self.update_pos(self.z_pos, Z))
+
+    def traverse(self, target):
+        self.move_to(target, self.traverse_ivl_native)
+        self.emit('Qm')
+
+    def cut(self, target, ivl, pulse_distance=None):
+        d, md = self.move_to(target, ivl)
+        if pulse_distance and md:
+            self.assign('pd', self.choose_pd(d, md, pulse_distance))
+        self.emit('Qc')
+
+    def move_to(self, target, ivl):
+        (xd, yd, zd) = (t - h for (t, h) in zip(target, self.head))
+        self.head = target
         d = sqrt(xd**2 + yd**2 + zd**2)
+        md = max(abs(xd), abs(yd), abs(zd))
         mt = d * ivl
-        self.emit('xd=%+d' % xd,
-                  'yd=%+d' % yd,
-                  'zd=%+d' % zd,
-                  'mt=%d' % mt)
-        return d
+        self.assign('xd', xd)
+        self.assign('yd', yd)
+        self.assign('zd', zd)
+        self.assign('mt', int(mt))
+        return d, md
 
     def update_pos(self, pos, amount):
         if amount is None:
-            return 0
+            return pos.pos_usteps
         if self.distance_mode == DistanceMode.absolute:
             if not self.abs_position_known:
                 msg = "can't use absolute position; current position unknown."
@@ -480,9 +508,7 @@ class LaserExecutor(Executor, XYArcMixin):
             pos.pos_units = amount
         else:
             pos.pos_units += amount
-        prev_usteps = pos.pos_usteps
-        new_usteps = pos.update_pos_usteps(self.distance_units)
-        return new_usteps - prev_usteps
+        return pos.update_pos_usteps(self.distance_units)
 
     def get_enum(self, code, sub_code, enum, number):
         value = ApproximateNumber.getitem(enum._map, number)
@@ -507,6 +533,58 @@ class LaserExecutor(Executor, XYArcMixin):
             ivl *= 25.4
         return ivl
 
+    def choose_pd(self, d, md, pulse_distance):
+
+        # The back end fires md / pd pulses along the major axis, in
+        # integer division.  Any pd that gives the right count will
+        # do, so keep the firmware's current pd if it does.
+        count = max(1, min(md, int(round(d / pulse_distance))))
+        lo = md // (count + 1) + 1
+        hi = md // count
+        pd = self.fw_vars.get('pd')
+        if pd is not None and lo <= pd <= hi:
+            return pd
+        ideal = int(round(pulse_distance * md / d))
+        return max(1, min(hi, max(lo, ideal)))
+
+    # The firmware keeps its variables' values between segments, so an
+    # assignment is only sent when the value changes.  The values are
+    # unknown until the first assignment.
+
+    def assign(self, name, value):
+        cmd = self.assignment(name, value)
+        if cmd:
+            self.emit(cmd)
+
+    def assignment(self, name, value):
+
+        """Return the assignment's S-code, or None if it is elided."""
+
+        if self.fw_vars.get(name) == value:
+            return None
+        self.fw_vars[name] = value
+        if proto_vars[name].type == 'signed':
+            return '%s=%+d' % (name, value)
+        return '%s=%s' % (name, value)
+
+    def finish(self):
+
+        """Called at the end of the job."""
+
+        self.link.report()
+
     def emit(self, *cmds):
         for cmd in cmds:
             print cmd
+            self.model_link(cmd)
+
+    def model_link(self, cmd):
+
+        """Follow a command that was just written down the link."""
+
+        self.link.send(len(cmd) + 1)
+        if cmd in ('Qc', 'Qd', 'Qm'):
+            secs = float(self.fw_vars['mt']) / F_CPU
+            self.link.segment(secs, self.pos)
+        elif cmd in ('Qh', 'W'):
+            self.link.wait()
@@ -0,0 +1,88 @@
+"""Serial link bandwidth model"""
+
+import sys
+
+
+LINK_RATE = 11520               # bytes/sec: 115200 baud, 10 bits/byte
+
+
+# The back end can't schedule a segment until its enqueue command has
+# arrived.  If the queued motion runs out first, the machine stalls
+# between segments, and the job is link-bound.  LinkModel follows the
+# S-code down the link to find out.  It assumes the back end schedules
+# each segment in no time, so it is optimistic.
+
+class LinkModel(object):
+
+    def __init__(self, rate=LINK_RATE, out=None):
+        self.rate = rate
+        self.out = out or sys.stderr
+        self.bytes = 0
+        self.segment_bytes = 0
+        self.segments = 0
+        self.machine_secs = 0.0
+        self.end = 0.0          # when queued motion ends
+        self.running = False    # queued motion since the last wait
+        self.stall_secs = 0.0
+        self.stalls = 0
+        self.peak_rate = 0.0
+        self.peak_pos = None
+
+    def send(self, nbytes):
+        self.bytes += nbytes
+        self.segment_bytes += nbytes
+
+    def segment(self, secs, pos):
+
+        """Account for a segment whose command was just sent."""
+
+        arrival = float(self.bytes) / self.rate
+        start = self.end
+        if arrival > start:
+            if self.running:
+                if not self.stalls:
+                    self.warn(pos, 'link-bound: machine stalls %.1f ms'
+                                   % (1000 * (arrival - start)))
+                self.stalls += 1
+                self.stall_secs += arrival - start
+            start = arrival
+        self.end = start + secs
+        self.running = True
+        self.segments += 1
+        self.machine_secs += secs
+        if secs:
+            rate = self.segment_bytes / secs
+            if rate > self.peak_rate:
+                self.peak_rate = rate
+                self.peak_pos = pos
+        self.segment_bytes = 0
+
+    def wait(self):
+
+        """The back end finishes all queued motion before reading on."""
+
+        self.running = False
+        self.segment_bytes = 0
+
+    def warn(self, pos, msg):
+        if pos:
+            print >>self.out, '%s:%s: %s' % (pos.source, pos.lineno, msg)
+        else:
+            print >>self.out, msg
+
+    def report(self):
+        if not self.segments:
+            return
+        needed = self.bytes / self.machine_secs if self.machine_secs else 0
+        print >>self.out, ('S-code: %d bytes, %d segments, '
+                           'machine time %.1f s'
+                           % (self.bytes, self.segments, self.machine_secs))
+        print >>self.out, ('link: needs %.0f bytes/s on average, '
+                           'carries %d' % (needed, self.rate))
+        if self.peak_pos:
+            self.warn(self.peak_pos, 'busiest segment needs %.0f bytes/s'
+                                     % self.peak_rate)
+        if self.stalls:
+            self.warn(None, 'link-bound: machine stalls %.1f s '
+                            'in %d segments at the requested feed'
+                            % (self.stall_secs, self.stalls))
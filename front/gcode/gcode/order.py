@@ -0,0 +1,301 @@
+"""Travel ordering: cut contours in an order that shortens traverses"""
+
+from math import hypot
+import sys
+
+from gcode.laser import LaserExecutor
+
+
+# Only contours within one block are reordered.  A block ends when
+# anything but a move is emitted (a setting changes, a dwell, homing)
+# or a move changes Z.  So every contour is cut with the settings
+# it was written with.
+#
+# A contour is a run of cuts.  A closed contour may start at any of
+# its vertices, and an open one at either end.  A contour that lies
+# inside a closed contour is cut first, so the inner piece is cut
+# before the outer one can shift or drop out.
+
+TWO_OPT_SPAN = 200              # longest run of contours 2-opt reverses
+TWO_OPT_PASSES = 10
+
+
+def distance(p, q):
+    return hypot(p[0] - q[0], p[1] - q[1])
+
+
+class Contour(object):
+
+    def __init__(self, start):
+        self.points = [start]
+        self.moves = []         # (ivl, pulse_distance, pos) per segment
+
+    def add(self, target, move):
+        self.points.append(target)
+        self.moves.append(move)
+
+    @property
+    def closed(self):
+        return len(self.points) > 2 and self.points[0] == self.points[-1]
+
+    @property
+    def entry(self):
+        return self.points[0]
+
+    @property
+    def exit(self):
+        return self.points[-1]
+
+    def bbox(self):
+        xs = [p[0] for p in self.points]
+        ys = [p[1] for p in self.points]
+        return (min(xs), min(ys), max(xs), max(ys))
+
+    def reverse(self):
+        self.points.reverse()
+        self.moves.reverse()
+
+    def rotate(self, i):
+        # Start a closed contour at vertex i.
+        self.points = self.points[i:-1] + self.points[:i + 1]
+        self.moves = self.moves[i:] + self.moves[:i]
+
+    def nearest_start(self, p):
+        # Return (distance, how) for the best place to start from p.
+        if self.closed:
+            return min((distance(p, q), i)
+                       for (i, q) in enumerate(self.points[:-1]))
+        d0 = distance(p, self.entry)
+        d1 = distance(p, self.exit)
+        return (d0, 0) if d0 <= d1 else (d1, -1)
+
+    def start_nearest(self, p):
+        (d, how) = self.nearest_start(p)
+        if self.closed:
+            if how:
+                self.rotate(how)
+        elif how:
+            self.reverse()
+
+    def contains(self, p):
+        # Ray casting; only meaningful for closed contours.
+        inside = False
+        pts = self.points
+        for (a, b) in zip(pts, pts[1:]):
+            if (a[1] > p[1]) != (b[1] > p[1]):
+                x = a[0] + (p[1] - a[1]) * (b[0] - a[0]) / float(b[1] - a[1])
+                if p[0] < x:
+                    inside = not inside
+        return inside
+
+
+def bbox_distance(p, box):
+    dx = max(box[0] - p[0], 0, p[0] - box[2])
+    dy = max(box[1] - p[1], 0, p[1] - box[3])
+    return hypot(dx, dy)
+
+
+def find_inner_contours(contours):
+    # inner[i] is the set of contours that must be cut before i.
+    boxes = [c.bbox() for c in contours]
+    inner = [set() for c in contours]
+    for (i, outer) in enumerate(contours):
+        if not outer.closed:
+            continue
+        ob = boxes[i]
+        for (j, c) in enumerate(contours):
+            if i == j:
+                continue
+            b = boxes[j]
+            if not (ob[0] <= b[0] and ob[1] <= b[1] and
+                    b[2] <= ob[2] and b[3] <= ob[3]):
+                continue
+            if b == ob and c.closed and j > i:
+                continue        # coincident contours keep file order
+            if outer.contains(c.points[0]):
+                inner[i].add(j)
+    return inner
+
+
+def travel(order, contours, start):
+    total = 0
+    pos = start
+    for i in order:
+        total += distance(pos, contours[i].entry)
+        pos = contours[i].exit
+    return total
+
+
+def nearest_neighbor(contours, inner, start):
+    # Greedy: from where the head is, go to the nearest contour whose
+    # inner contours are done.  Bounding boxes give a lower bound on
+    # the distance, so most contours' vertices needn't be searched.
+    boxes = [c.bbox() for c in contours]
+    waiting = [set(s) for s in inner]
+    outers = [[] for c in contours]
+    for (i, s) in enumerate(inner):
+        for j in s:
+            outers[j].append(i)
+    ready = set(i for (i, s) in enumerate(waiting) if not s)
+    order = []
+    pos = start
+    while ready:
+        cands = sorted((bbox_distance(pos, boxes[i]), i) for i in ready)
+        best = None
+        for (lower, i) in cands:
+            if best and lower >= best[0]:
+                break
+            (d, how) = contours[i].nearest_start(pos)
+            if best is None or d < best[0]:
+                best = (d, i)
+        i = best[1]
+        ready.remove(i)
+        contours[i].start_nearest(pos)
+        order.append(i)
+        pos = contours[i].exit
+        for k in outers[i]:
+            waiting[k].discard(i)
+            if not waiting[k]:
+                ready.add(k)
+    assert len(order) == len(contours)
+    return order
+
+
+def two_opt(order, contours, inner, start):
+    # Reverse runs of contours while that shortens travel and keeps
+    # every inner contour ahead of its outer one.  A reversed open
+    # contour is cut backward.
+    n = len(order)
+
+    def entry(i, flipped):
+        c = contours[order[i]]
+        return c.exit if flipped else c.entry
+
+    def exit(i, flipped):
+        c = contours[order[i]]
+        return c.entry if flipped else c.exit
+
+    for npass in range(TWO_OPT_PASSES):
+        improved = False
+        for i in range(n - 1):
+            prev = exit(i - 1, False) if i else start
+            for j in range(i + 1, min(n, i + TWO_OPT_SPAN)):
+                old = distance(prev, entry(i, False))
+                new = distance(prev, entry(j, True))
+                if j + 1 < n:
+                    nxt = entry(j + 1, False)
+                    old += distance(exit(j, False), nxt)
+                    new += distance(exit(i, True), nxt)
+                if new >= old - 1e-9:
+                    continue
+                run = set(order[i:j + 1])
+                if any(inner[k] & run for k in run):
+                    continue
+                order[i:j + 1] = order[i:j + 1][::-1]
+                for k in order[i:j + 1]:
+                    if not contours[k].closed:
+                        contours[k].reverse()
+                improved = True
+        if not improved:
+            break
+    return order
+
+
+class TravelOrderExecutor(LaserExecutor):
+
+    """LaserExecutor that reorders contours to shorten travel"""
+
+    def __init__(self, out=None):
+        super(TravelOrderExecutor, self).__init__()
+        self.out = out or sys.stderr
+        self.contours = []
+        self.end = None         # last traverse target in the block
+        self.flushing = False
+        self.travel_before = 0
+        self.travel_after = 0
+
+    def traverse(self, target):
+        if target[2] != self.block_pos()[2]:
+            self.flush()
+            return super(TravelOrderExecutor, self).traverse(target)
+        self.end = target
+
+    def cut(self, target, ivl, pulse_distance=None):
+        pos = self.block_pos()
+        if target[2] != pos[2]:
+            self.flush()
+            return super(TravelOrderExecutor, self).cut(target, ivl,
+                                                        pulse_distance)
+        if self.end is not None or not self.contours:
+            self.contours.append(Contour(pos))
+            self.end = None
+        self.contours[-1].add(target, (ivl, pulse_distance, self.pos))
+
+    def block_pos(self):
+        # Where the head would be, in file order.
+        if self.end is not None:
+            return self.end
+        if self.contours:
+            return self.contours[-1].exit
+        return self.head
+
+    # Anything else ends the block.  Flush before an assignment, too,
+    # so the held moves are emitted before the value changes.
+
+    def assign(self, name, value):
+        if not self.flushing:
+            self.flush()
+        super(TravelOrderExecutor, self).assign(name, value)
+
+    def emit(self, *cmds):
+        if not self.flushing:
+            self.flush()
+        super(TravelOrderExecutor, self).emit(*cmds)
+
+    # The held moves are replayed through LaserExecutor's traverse()
+    # and cut(), not self's, so a stage above this one in the MRO
+    # doesn't take them back.
+
+    def flush(self):
+        contours, end = self.contours, self.end
+        self.contours, self.end = [], None
+        if not contours:
+            if end is not None:
+                self.flushing = True
+                super(TravelOrderExecutor, self).traverse(end)
+                self.flushing = False
+            return
+        start = self.head
+        before = travel(range(len(contours)), contours, start)
+        inner = find_inner_contours(contours)
+        order = nearest_neighbor(contours, inner, start)
+        order = two_opt(order, contours, inner, start)
+        self.travel_before += before
+        self.travel_after += travel(order, contours, start)
+
+        self.flushing = True
+        line_pos = self.pos
+        for i in order:
+            c = contours[i]
+            if c.entry != self.head:
+                self.pos = c.moves[0][2]
+                super(TravelOrderExecutor, self).traverse(c.entry)
+            for (target, (ivl, pulse_distance, pos)) in zip(c.points[1:],
+                                                            c.moves):
+                self.pos = pos
+                super(TravelOrderExecutor, self).cut(target, ivl,
+                                                     pulse_distance)
+        if end is not None and end != self.head:
+            super(TravelOrderExecutor, self).traverse(end)
+        self.pos = line_pos
+        self.flushing = False
+
+    def finish(self):
+        self.flush()
+        if self.travel_before:
+            print >>self.out, ('travel: %.0f usteps in file order, '
+                               '%.0f ordered (%.0f%% shorter)'
+                               % (self.travel_before, self.travel_after,
+                                  100 - 100 * self.travel_after /
+                                  self.travel_before))
+        super(TravelOrderExecutor, self).finish()
@@ -0,0 +1,247 @@
+# This file was automatically generated from these inputs.
+#
+#    script:          tools/bin/gen-proto-defs.py
+#    protocol config: config/protocol.py
+
+from collections import namedtuple
+
+Command = namedtuple('Command', 'name action')
+EnumValue = namedtuple('EnumValue', 'code name label')
+Variable = namedtuple('Variable', 'name type values short_name full_name '
+                                  'observed report')
+Fault = namedtuple('Fault', 'name description')
+
+# Variable types are 'unsigned', 'signed' or 'enum'.  An enum
+# variable's values are listed with the default first.
+
+commands = (
+    Command('Da', 'disable_air_pump'),
+    Command('Dh', 'disable_high_voltage'),
+    Command('Dl', 'disable_low_voltage'),
+    Command('Dr', 'disable_reporting'),
+    Command('Dw', 'disable_water_pump'),
+    Command('Dx', 'disable_X_motor'),
+    Command('Dy', 'disable_Y_motor'),
+    Command('Dz', 'disable_Z_motor'),
+    Command('Ea', 'enable_air_pump'),
+    Command('Eh', 'enable_high_voltage'),
+    Command('El', 'enable_low_voltage'),
+    Command('Er', 'enable_reporting'),
+    Command('Ew', 'enable_water_pump'),
+    Command('Ex', 'enable_X_motor'),
+    Command('Ey', 'enable_Y_motor'),
+    Command('Ez', 'enable_Z_motor'),
+    Command('I', 'illuminate'),
+    Command('P', 'power'),
+    Command('Qc', 'enqueue_cut'),
+    Command('Qd', 'enqueue_dwell'),
+    Command('Qe', 'enqueue_engrave'),
+    Command('Qh', 'enqueue_home'),
+    Command('Qm', 'enqueue_move'),
+    Command('R', 'report_status'),
+    Command('S', 'stop'),
+    Command('W', 'wait'),
+    )
+
+variables = (
+    Variable('ia', 'enum',
+             (
+                 EnumValue('n', 'none', 'None'),
+                 EnumValue('c', 'complete', 'Complete'),
+                 EnumValue('s', 'startup', 'Startup'),
+                 EnumValue('w', 'warning', 'Warning'),
+                 EnumValue('a', 'alert', 'Alert'),
+             ),
+             'Illum. Anim.', 'Illumination Animation',
+             False, None),
+    Variable('il', 'unsigned',
+             (),
+             'Illum. Level', 'Illumination Level',
+             False, None),
+    Variable('lp', 'unsigned',
+             (),
+             'Laser Power', 'Laser Power',
+             False, None),
+    Variable('ls', 'enum',
+             (
+                 EnumValue('n', 'none', 'None'),
+                 EnumValue('m', 'main', 'Main Laser'),
+                 EnumValue('v', 'visible', 'Visible Laser'),
+             ),
+             'Laser Select', 'Laser Select',
+             True, None),
+    Variable('mt', 'unsigned',
+             (),
+             'Move Time', 'Move Time',
+             False, None),
+    Variable('oc', 'enum',
+             (
+                 EnumValue('n', 'no', 'No'),
+                 EnumValue('y', 'yes', 'Yes'),
+             ),
+             "O'ride Lid Shut", 'Override Lid Closed',
+             True, None),
+    Variable('oo', 'enum',
+             (
+                 EnumValue('n', 'no', 'No'),
+                 EnumValue('y', 'yes', 'Yes'),
+             ),
+             "O'ride Lid Open", 'Override Lid Open',
+             True, None),
+    Variable('pd', 'unsigned',
+             (),
+             'Pulse Distance', 'Pulse Distance',
+             False, None),
+    Variable('pi', 'unsigned',
+             (),
+             'Pulse Interval', 'Pulse Interval',
+             False, None),
+    Variable('pm', 'enum',
+             (
+                 EnumValue('o', 'off', 'Off'),
+                 EnumValue('c', 'continuous', 'Continuous'),
+                 EnumValue('t', 'timed', 'Timed'),
+                 EnumValue('d', 'distance', 'Distance'),
+             ),
+             'Pulse Mode', 'Pulse Mode',
+             False, None),
+    Variable('pw', 'unsigned',
+             (),
+             'Pulse Width', 'Pulse Width',
+             False, None),
+    Variable('ra', 'enum',
+             (
+                 EnumValue('y', 'yes', 'Yes'),
+                 EnumValue('n', 'no', 'No'),
+             ),
+             'Report Axes', 'Report Axis Positions',
+             False, 'positions'),
+    Variable('re', 'enum',
+             (
+                 EnumValue('y', 'yes', 'Yes'),
+                 EnumValue('n', 'no', 'No'),
+             ),
+             'Report E-Stop', 'Report Emergency Stop Status',
+             False, 'e_stop'),
+    Variable('rf', 'enum',
+             (
+                 EnumValue('y', 'yes', 'Yes'),
+                 EnumValue('n', 'no', 'No'),
+             ),
+             'Report Faults', 'Report Fault Status',
+             False, 'faults'),
+    Variable('ri', 'unsigned',
+             (),
+             'Rep. Interval', 'Reporting Interval (msec)',
+             False, None),
+    Variable('rl', 'enum',
+             (
+                 EnumValue('n', 'no', 'No'),
+                 EnumValue('y', 'yes', 'Yes'),
+             ),
+             'Report Limits', 'Report Limit Switch Status',
+             False, 'limit_switches'),
+    Variable('rm', 'enum',
+             (
+                 EnumValue('n', 'no', 'No'),
+                 EnumValue('y', 'yes', 'Yes'),
+             ),
+             'Report Motors', 'Report Motor Status',
+             False, 'motors'),
+    Variable('rn', 'enum',
+             (
+                 EnumValue('n', 'no', 'No'),
+                 EnumValue('y', 'yes', 'Yes'),
+             ),
+             'Report Seg. Nums', 'Report Segment Numbers',
+             False, 'segments'),
+    Variable('ro', 'enum',
+             (
+                 EnumValue('n', 'no', 'No'),
+                 EnumValue('y', 'yes', 'Yes'),
+             ),
+             "Report O'rides", 'Report Feed Override and Hold',
+             False, 'overrides'),
+    Variable('rp', 'enum',
+             (
+                 EnumValue('n', 'no', 'No'),
+                 EnumValue('y', 'yes', 'Yes'),
+             ),
+             'Report Power', 'Report Power Status',
+             False, 'power'),
+    Variable('rq', 'enum',
+             (
+                 EnumValue('n', 'no', 'No'),
+                 EnumValue('y', 'yes', 'Yes'),
+             ),
+             'Report Queues', 'Report Queue Status',
+             False, 'queues'),
+    Variable('rr', 'enum',
+             (
+                 EnumValue('n', 'no', 'No'),
+                 EnumValue('y', 'yes', 'Yes'),
+             ),
+             'Report RAM Use', 'Report RAM Status',
+             False, 'RAM'),
+    Variable('rs', 'enum',
+             (
+                 EnumValue('n', 'no', 'No'),
+                 EnumValue('y', 'yes', 'Yes'),
+             ),
+             'Report Serial', 'Report Serial Status',
+             False, 'serial'),
+    Variable('rt', 'enum',
+             (
+                 EnumValue('n', 'no', 'No'),
+                 EnumValue('y', 'yes', 'Yes'),
+             ),
+             'Report Timing', 'Report Latency Histograms',
+             False, 'timing'),
+    Variable('rv', 'enum',
+             (
+                 EnumValue('n', 'no', 'No'),
+                 EnumValue('y', 'yes', 'Yes'),
+             ),
+             'Report Vars', 'Report Variables',
+             False, 'variables'),
+    Variable('rw', 'enum',
+             (
+                 EnumValue('n', 'no', 'No'),
+                 EnumValue('y', 'yes', 'Yes'),
+             ),
+             'Report Water', 'Report Water Status',
+             False, 'water'),
+    Variable('sn', 'unsigned',
+             (),
+             'Segment Number', 'Next Segment Number',
+             False, None),
+    Variable('xd', 'signed',
+             (),
+             'X Distance', 'X Distance',
+             False, None),
+    Variable('yd', 'signed',
+             (),
+             'Y Distance', 'Y Distance',
+             False, None),
+    Variable('zd', 'signed',
+             (),
+             'Z Distance', 'Z Distance',
+             False, None),
+    )
+
+faults = (
+    Fault('ES', 'Emergency Stop'),
+    Fault('LO', 'Lid Open'),
+    Fault('LC', 'Lid Closed'),
+    Fault('WF', 'Water Flow'),
+    Fault('WT', 'Water Temperature'),
+    Fault('LS', 'Limit Switch Stuck'),
+    Fault('SF', 'Serial Frame Error'),
+    Fault('SO', 'Serial Overrun'),
+    Fault('SP', 'Serial Parity Error'),
+    Fault('SL', 'Software Lexical Error'),
+    Fault('SS', 'Software Syntax Error'),
+    Fault('SU', 'Software Underflow'),
+    Fault('SI', 'Software Missed Interrupt'),
+    Fault('LP', 'Laser Power DAC Error'),
+    )
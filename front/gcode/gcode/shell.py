@@ -4,11 +4,14 @@
 
    If standard input and standard output are a terminal, then it
    interactively prompts for and executes commands.  Otherwise, it
-   reads from files on command line or from standard output.
+   reads from files on command line or from standard output.  With
+   --jobs, it translates each file separately, several at a time.
 """
 
 import argparse
 import atexit
+from cStringIO import StringIO
+import multiprocessing
 import os
 import sys
 import time
@@ -34,8 +37,8 @@ def open_files(files):
     else:
         yield sys.stdin
 
-def cat(files):
-    interp = gcode.Interpreter()
+def cat(files, executor):
+    interp = gcode.Interpreter(executor)
     for f in open_files(files):
         try:
             while True:
@@ -51,6 +54,92 @@ def cat(files):
         except gcode.GCodeSyntaxError:
             traceback.print_exc(0)
             break
+    interp.executor.finish()
+
+
+# With --jobs, each file is an independent job, translated in a pool
+# of worker processes.  A job's S-code goes to a file beside it with
+# the suffix .sc.  The reports and errors are collected and printed
+# in command line order, so the output doesn't depend on scheduling.
+
+def output_file(file):
+    return os.path.splitext(file)[0] + '.sc'
+
+def where(file, executor):
+
+    """Return the file and line the executor is at, as "file:line"."""
+
+    pos = executor and executor.pos
+    if pos is None:
+        return file
+    return '%s:%s' % (pos.source, pos.lineno)
+
+def translate(job):
+
+    """Translate one file.  Return (error, report, seconds)."""
+
+    # Any exception is the job's error, so one bad file can't stop the
+    # others, and its partial S-code is removed.
+
+    (file, args) = job
+    start = time.time()
+    out_file = output_file(file)
+    if out_file == file:
+        return ('%s: input is already S-code' % file, '', 0)
+    report = StringIO()
+    error = None
+    executor = None
+    try:
+        with open(file) as f:
+            out = open(out_file, 'w')
+            sys.stdout, sys.stderr = out, report
+            try:
+                executor = make_executor(args)
+                interp = gcode.Interpreter(executor)
+                while True:
+                    a = interp.interpret_file(f, source=file)
+                    if a is None or a in ('End', 'Emergency Stop'):
+                        break
+                    print >>report, a
+                executor.finish()
+            except gcode.GCodeSyntaxError as e:
+                (msg, pos) = e.args
+                error = '%s:%s: %s' % (pos.source, pos.lineno, msg)
+            except gcode.GCodeException as e:
+                error = '%s: %s' % (where(file, executor), e)
+            except Exception as e:
+                error = '%s: %s: %s' % (where(file, executor),
+                                        type(e).__name__, e)
+            finally:
+                sys.stdout, sys.stderr = sys.__stdout__, sys.__stderr__
+                out.close()
+    except IOError as e:
+        error = '%s: %s' % (e.filename, e.strerror)
+    if error and os.path.exists(out_file):
+        os.remove(out_file)
+    return (error, report.getvalue(), time.time() - start)
+
+def translate_all(files, args):
+    start = time.time()
+    pool = multiprocessing.Pool(args.jobs)
+    results = pool.imap(translate, [(file, args) for file in files])
+    failed = 0
+    work = 0
+    for (file, (error, report, secs)) in zip(files, results):
+        sys.stderr.write(report)
+        if error:
+            print >>sys.stderr, error
+            failed += 1
+        else:
+            print >>sys.stderr, '%s -> %s' % (file, output_file(file))
+        work += secs
+    pool.close()
+    pool.join()
+    elapsed = time.time() - start
+    print >>sys.stderr, ('%d files, %d failed: %.1f s of work in %.1f s '
+                         'with %d jobs'
+                         % (len(files), failed, work, elapsed, args.jobs))
+    return failed == 0
 
 
 def restart_as_needed():
@@ -111,13 +200,41 @@ def interact():
 def is_interactive():
     return all(os.isatty(f.fileno()) for f in (sys.stdin, sys.stdout))
 
+def make_executor(args):
+
+    # The stages are mixins of LaserExecutor.  Simplification comes
+    # first in the MRO, so ordering sees the simplified contours.
+    # Batching comes last, so it emits every stage's moves.
+
+    stages = []
+    if args.simplify is not None:
+        stages.append(gcode.SimplifyExecutor)
+    if args.order:
+        stages.append(gcode.TravelOrderExecutor)
+    stages.append(gcode.BatchExecutor)
+    cls = type('Executor', tuple(stages), {})
+    if args.simplify is not None:
+        return cls(tolerance=args.simplify)
+    return cls()
+
 def main(argv):
     desc = 'G-Code command-line shell'
     p = argparse.ArgumentParser(description=desc)
+    p.add_argument('-o', '--order', action='store_true',
+                   help='reorder contours to shorten travel')
+    p.add_argument('-s', '--simplify', type=float, metavar='USTEPS',
+                   help='merge cuts within USTEPS microsteps of a line')
+    p.add_argument('-j', '--jobs', type=int, metavar='N',
+                   help='translate each file to FILE.sc, N at a time')
     p.add_argument('file', nargs='*', help='G-Code source file')
     args = p.parse_args()
+    if args.jobs is not None:
+        if args.jobs < 1 or not args.file:
+            p.error('--jobs needs N >= 1 and files')
+        sys.exit(0 if translate_all(args.file, args) else 1)
+    executor = make_executor(args)
     if args.file or not is_interactive():
-        cat(args.file)
+        cat(args.file, executor)
     else:
         interact()
 
@@ -0,0 +1,127 @@
+"""Polyline simplification: merge cuts that stay near a straight line"""
+
+from math import hypot
+import sys
+
+from gcode.laser import LaserExecutor
+
+
+# Vector art converted to G-code often draws a curve as many short,
+# nearly collinear cuts.  Each one is a segment the firmware has to
+# receive and schedule, and the link may not keep up.  So consecutive
+# cuts at the same settings are held as a run, and the run is
+# simplified by Ramer-Douglas-Peucker: a vertex is kept only if
+# dropping it would move the path more than the tolerance.
+#
+# A run ends at anything but a cut (a traverse, a setting change, a
+# dwell), at a cut with a different feed or pulse distance, and at a
+# Z move.  Kept vertices are the G-code's own, so the simplified path
+# is never farther than the tolerance from the original.
+
+SIMPLIFY_TOLERANCE = 1          # usteps
+
+
+def segment_distance(p, a, b):
+    # Distance from p to the segment from a to b.
+    (dx, dy) = (b[0] - a[0], b[1] - a[1])
+    dd = dx * dx + dy * dy
+    if dd:
+        t = ((p[0] - a[0]) * dx + (p[1] - a[1]) * dy) / float(dd)
+        t = max(0, min(1, t))
+    else:
+        t = 0
+    return hypot(p[0] - a[0] - t * dx, p[1] - a[1] - t * dy)
+
+
+def simplify(points, tolerance):
+
+    """Return the indices of the points to keep."""
+
+    # Iterative, so a long run can't exceed the recursion limit.
+    keep = [False] * len(points)
+    keep[0] = keep[-1] = True
+    stack = [(0, len(points) - 1)]
+    while stack:
+        (i, j) = stack.pop()
+        (a, b) = (points[i], points[j])
+        (dmax, kmax) = (0, None)
+        for k in range(i + 1, j):
+            d = segment_distance(points[k], a, b)
+            if d > dmax:
+                (dmax, kmax) = (d, k)
+        if dmax > tolerance:
+            keep[kmax] = True
+            stack.append((i, kmax))
+            stack.append((kmax, j))
+    return [i for (i, k) in enumerate(keep) if k]
+
+
+class SimplifyExecutor(LaserExecutor):
+
+    """LaserExecutor that merges nearly collinear cuts"""
+
+    def __init__(self, tolerance=SIMPLIFY_TOLERANCE, out=None):
+        super(SimplifyExecutor, self).__init__()
+        self.tolerance = tolerance
+        self.out = out or sys.stderr
+        self.run = None         # (ivl, pulse_distance, points, poses)
+        self.simplifying = False
+        self.cuts_before = 0
+        self.cuts_after = 0
+
+    def traverse(self, target):
+        self.flush_run()
+        super(SimplifyExecutor, self).traverse(target)
+
+    def cut(self, target, ivl, pulse_distance=None):
+        run = self.run
+        if run and run[:2] == (ivl, pulse_distance) and \
+           run[2][-1] == self.origin and target[2] == self.origin[2]:
+            run[2].append(target)
+            run[3].append(self.pos)
+            return
+        self.flush_run()
+        if target[2] != self.origin[2]:
+            return super(SimplifyExecutor, self).cut(target, ivl,
+                                                     pulse_distance)
+        self.run = (ivl, pulse_distance, [self.origin, target], [self.pos])
+
+    # Anything else ends the run.
+
+    def assign(self, name, value):
+        if not self.simplifying:
+            self.flush_run()
+        super(SimplifyExecutor, self).assign(name, value)
+
+    def emit(self, *cmds):
+        if not self.simplifying:
+            self.flush_run()
+        super(SimplifyExecutor, self).emit(*cmds)
+
+    def flush_run(self):
+        run, self.run = self.run, None
+        if not run:
+            return
+        (ivl, pulse_distance, points, poses) = run
+        keep = simplify(points, self.tolerance)
+        self.cuts_before += len(points) - 1
+        self.cuts_after += len(keep) - 1
+
+        # Each merged cut is reported at the last line it covers.
+        self.simplifying = True
+        line_pos = self.pos
+        for i in keep[1:]:
+            self.pos = poses[i - 1]
+            super(SimplifyExecutor, self).cut(points[i], ivl, pulse_distance)
+        self.pos = line_pos
+        self.simplifying = False
+
+    def finish(self):
+        self.flush_run()
+        if self.cuts_before:
+            print >>self.out, ('simplify: %d cuts, %d after '
+                               '(%.0f%% fewer)'
+                               % (self.cuts_before, self.cuts_after,
+                                  100 - 100.0 * self.cuts_after /
+                                  self.cuts_before))
+        super(SimplifyExecutor, self).finish()
@@ -0,0 +1,50 @@
+#include "controller_client.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "client.h"
+#include "io.h"
+
+int be_controller(const char **commands)
+{
+    // Connect to the daemon.
+    int sock = connect_or_start_daemon(CT_CONTROLLER);
+    if (sock < 0)
+        return EXIT_FAILURE;
+
+    // Send each command and await the daemon's response.
+    int status = EXIT_SUCCESS;
+    for ( ; *commands; commands++) {
+        char line[300];
+        int nb = snprintf(line, sizeof line, "%s\n", *commands);
+        if (nb < 0 || (size_t)nb >= sizeof line) {
+            fprintf(stderr, "thruport: control command too long\n");
+            status = EXIT_FAILURE;
+            continue;
+        }
+        if (write(sock, line, nb) != nb) {
+            perror("write to daemon failed");
+            status = EXIT_FAILURE;
+            break;
+        }
+        // Copy any information lines, then check the status.
+        ssize_t nr;
+        while ((nr = read_line(sock, line, sizeof line)) > 0 &&
+               !strncmp(line, "+ ", 2))
+            fputs(line + 2, stdout);
+        if (nr <= 0) {
+            fprintf(stderr, "thruport: daemon not responding\n");
+            status = EXIT_FAILURE;
+            break;
+        }
+        if (strcmp(line, "OK\n")) {
+            fputs(line, stderr);
+            status = EXIT_FAILURE;
+        }
+    }
+    (void)close(sock);
+    return status;
+}
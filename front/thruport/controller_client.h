@@ -0,0 +1,9 @@
+#ifndef CONTROLLER_CLIENT_included
+#define CONTROLLER_CLIENT_included
+
+// Pass a NULL-terminated list of commands.  (E.g., the tail of argv.)
+//
+// Returns process exit status.
+extern int be_controller(const char **commands);
+
+#endif /* !CONTROLLER_CLIENT_included */
@@ -0,0 +1,133 @@
+#include "controller_service.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "daemon.h"
+#include "io.h"
+#include "spool.h"
+
+// A controller client sends one command per line, and the service
+// answers each with "OK" or an error message.  Most commands are one
+// control byte, which the back end acts on in its serial receive
+// interrupt.  The service sends the byte at once, ahead of any sender
+// data waiting for flow control.  The job and statistics commands
+// are handled in the daemon instead.  They may send lines of
+// information, each starting with "+ ", before the "OK".
+//
+// Each controller gets its own detached thread, so a controller is
+// never blocked by the sender or by another controller.
+
+typedef int control_action(char *msg, size_t size);
+
+typedef struct control_command {
+    const char     *cc_name;
+    char            cc_byte;
+    control_action *cc_action;
+} control_command;
+
+
+// These must match the control bytes in back/serial.c.
+static const control_command commands[] = {
+    { "stop",       '\003' },   // ETX: emergency stop
+    { "hold",       '\x80' },
+    { "resume",     '\x81' },
+    { "feed=100",   '\x82' },
+    { "feed+10",    '\x83' },
+    { "feed-10",    '\x84' },
+    { "feed+1",     '\x85' },
+    { "feed-1",     '\x86' },
+    { "jobs",       0, describe_jobs  },
+    { "resume-job", 0, spool_resume   },
+    { "cancel-job", 0, cancel_job     },
+    { "stats",      0, describe_stats },
+};
+static const size_t command_count = sizeof commands / sizeof commands[0];
+
+static const control_command *find_command(const char *name)
+{
+    for (size_t i = 0; i < command_count; i++)
+        if (!strcmp(name, commands[i].cc_name))
+            return &commands[i];
+    return NULL;
+}
+
+static void respond(int sock, const char *msg)
+{
+    (void)write(sock, msg, strlen(msg));
+}
+
+// Send each line of msg as information, then "OK".
+static void respond_info(int sock, const char *msg)
+{
+    while (*msg) {
+        size_t len = strcspn(msg, "\n");
+        char line[200];
+        snprintf(line, sizeof line, "+ %.*s\n", (int)len, msg);
+        respond(sock, line);
+        msg += len;
+        if (*msg)
+            msg++;
+    }
+    respond(sock, "OK\n");
+}
+
+static void *controller_thread_main(void *closure)
+{
+    int sock = (int)(intptr_t)closure;
+    char line[100];
+    ssize_t nr;
+    while ((nr = read_line(sock, line, sizeof line)) > 0) {
+        line[strcspn(line, "\n")] = '\0';
+        const control_command *cp = find_command(line);
+        if (!cp) {
+            char msg[sizeof line + 50];
+            snprintf(msg, sizeof msg,
+                     "thruport: unknown control command \"%s\"\n", line);
+            respond(sock, msg);
+            continue;
+        }
+        syslog(LOG_INFO, "control: %s", cp->cc_name);
+        if (cp->cc_action) {
+            char msg[1000];
+            if ((*cp->cc_action)(msg, sizeof msg) == 0)
+                respond_info(sock, msg);
+            else {
+                char reply[sizeof msg + 20];
+                snprintf(reply, sizeof reply, "thruport: %s\n", msg);
+                respond(sock, reply);
+            }
+        } else if (transmit_control(&cp->cc_byte, 1))
+            respond(sock, "thruport: serial port not available\n");
+        else
+            respond(sock, "OK\n");
+    }
+    if (nr < 0)
+        syslog(LOG_ERR, "controller read: %m");
+    if (close(sock))
+        syslog(LOG_ERR, "controller close failed: %m");
+    syslog(LOG_INFO, "EOF on controller");
+    return NULL;
+}
+
+void instantiate_controller_service(int sock)
+{
+    pthread_t thread;
+    int r = pthread_create(&thread, NULL, controller_thread_main,
+                           (void *)(intptr_t)sock);
+    if (r) {
+        syslog(LOG_ERR, "can't create controller thread: %s", strerror(r));
+        respond(sock, "thruport: can't create controller thread\n");
+        (void)close(sock);
+        return;
+    }
+    r = pthread_detach(thread);
+    if (r)
+        syslog(LOG_ERR, "can't detach controller thread: %s", strerror(r));
+}
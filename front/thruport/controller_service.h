@@ -0,0 +1,6 @@
+#ifndef CONTROLLER_SERVICE_included
+#define CONTROLLER_SERVICE_included
+
+extern void instantiate_controller_service(int sock);
+
+#endif /* !CONTROLLER_SERVICE_included */
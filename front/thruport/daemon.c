@@ -2,6 +2,7 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -15,20 +16,25 @@
 #include <sys/wait.h>
 
 #include "client.h"
+#include "controller_service.h"
 #include "debug.h"
 #include "fwsim.h"
 #include "io.h"
 #include "paths.h"
 #include "receiver_service.h"
+#include "report_decoder.h"
 #include "sender_service.h"
 #include "suspender_service.h"
 #include "serial.h"
+#include "spool.h"
 
-// The daemon has four threads.
+// The daemon has five threads.
 //   The acceptor thread listens for new client connections.
-//   The send thread copies data from the sender to the serial line.
+//   The spool thread copies data from the sender to the spool.
+//   The send thread copies data from the spool to the serial line.
 //   The receive thread broadcasts data from the serial port to the receivers.
 //   The main thread starts and stops the send and receive threads.
+// Controllers and suspenders each get a thread of their own.
 
 typedef void service_instantiation_func(int sock);
 
@@ -39,7 +45,7 @@ typedef struct service {
 } service;
 
 static const service services[] = {
-    // { "controller", CT_CONTROLLER, instantiate_controller_service },
+    { "controller", CT_CONTROLLER, instantiate_controller_service },
     { "sender",     CT_SENDER,     instantiate_sender_service     },
     { "receiver",   CT_RECEIVER,   instantiate_receiver_service   },
     { "suspender",  CT_SUSPENDER,  instantiate_suspender_service  },
@@ -69,12 +75,15 @@ static bool      use_fwsim     = false;
 static int       listen_socket = -1;
 static pthread_t main_thread;
 static pthread_t acceptor_thread;
+static pthread_t spool_thread;
 static pthread_t send_thread;
 static pthread_t receive_thread;
+static size_t    fwsim_sent;    // bulk bytes sent to the simulator
 
 // Poor man's virtual functions
 static int open_whatever(void)
 {
+    fwsim_sent = 0;
     return (use_fwsim ? open_fwsim : open_serial)();
 }
 
@@ -85,7 +94,11 @@ static void close_whatever(void)
 
 static int whatever_transmit(const char *buf, size_t count)
 {
-    return (use_fwsim ? fwsim_transmit : serial_transmit)(buf, count);
+    if (use_fwsim) {
+        fwsim_sent += count;
+        return fwsim_transmit(buf, count);
+    }
+    return serial_transmit(buf, count);
 }
 
 static ssize_t whatever_receive(char *buf, size_t max)
@@ -93,6 +106,23 @@ static ssize_t whatever_receive(char *buf, size_t max)
     return (use_fwsim ? fwsim_receive : serial_receive)(buf, max);
 }
 
+// The simulator sends no flow control credit.  It reads from a pipe,
+// so a byte counts as read once it is written.
+static size_t whatever_acknowledged(void)
+{
+    return use_fwsim ? fwsim_sent : serial_acknowledged();
+}
+
+static size_t whatever_await_acknowledged(size_t count)
+{
+    return use_fwsim ? fwsim_sent : serial_await_acknowledged(count);
+}
+
+static int whatever_transmit_urgent(const char *buf, size_t count)
+{
+    return (use_fwsim ? fwsim_transmit : serial_transmit_urgent)(buf, count);
+}
+
 static void report_daemon_error(const char *label)
 {
     int e = errno;
@@ -155,9 +185,15 @@ static int daemonize(void)
     }
 }
 
+// A socket's block size is only a page, so read senders in bigger
+// pieces.
+#define MIN_DATA_BUFSIZ (64 * 1024)
+
 static char *alloc_data_buf(int fd, size_t *size_out)
 {
     size_t blksize = fd_blksize(fd);
+    if (blksize < MIN_DATA_BUFSIZ)
+        blksize = MIN_DATA_BUFSIZ;
     char *buf = malloc(blksize);
     if (!buf) {
         syslog(LOG_CRIT, "out of memory: %m");
@@ -177,6 +213,8 @@ static void accept_client_connection(void)
         syslog(LOG_WARNING, "client accept failed: %m");
         return;
     }
+    // Keep clients' sockets out of the simulator's process.
+    (void)fcntl(client_sock, F_SETFD, FD_CLOEXEC);
     char line[100];
     ssize_t nr = read_line(client_sock, line, sizeof line);
     if (nr <= 0) {
@@ -290,38 +328,83 @@ static int init_service(void)
     return 0;
 }
 
-static void *send_thread_main(void *p)
+static void *spool_thread_main(void *p)
 {
     while (true) {
+        // A job from a previous daemon may still be waiting.  The
+        // next sender waits in the queue until it is resumed or
+        // cancelled.
+        (void)spool_await_job();
         int sock = await_sender_socket();
+        if (spool_begin_job()) {
+            report_sender_error(LOG_ERR, "can't spool job");
+            disconnect_sender(NULL);
+            continue;
+        }
         size_t buf_size = 0;
         char *buf = alloc_data_buf(sock, &buf_size);
-        while (true) {
+        bool ok = true;
+        while (ok) {
             ssize_t nr = read(sock, buf, buf_size);
             if (nr < 0) {
                 report_sender_error(LOG_ERR, "read from sender failed");
-                break;          // XXX stop daemon and clean up
-            }
-            if (nr == 0) {
+                ok = false;
+            } else if (nr == 0) {
                 syslog(LOG_INFO, "EOF on sender");
-                break;          // XXX stop daemon and clean up
+                break;
+            } else if (spool_append(buf, nr)) {
+                if (errno == EINVAL)
+                    report_sender_error(LOG_ERR, "job has a control byte "
+                                        "(ETX or high bit set)");
+                else if (errno != ECANCELED)
+                    report_sender_error(LOG_ERR, "can't spool job");
+                ok = false;
             }
-            if (whatever_transmit(buf, nr))
-                report_sender_error(LOG_ERR, "serial transmit failed");
         }
         free(buf);
-        disconnect_sender(NULL);
+        if (ok)
+            spool_end_input();
+        else
+            spool_cancel(NULL, 0);
+        bool done = spool_await_job();
+        disconnect_sender(done ? NULL : "job cancelled");
     }
     return NULL;
 }
 
+static void *send_thread_main(void *p)
+{
+    char buf[TTY_BUFSIZ];
+    size_t link_sent = 0;
+    while (true) {
+        size_t n = spool_take(buf, sizeof buf, link_sent);
+        if (n == 0) {
+            // The job is sent.  It ends when the back end has read it.
+            spool_note_acked(whatever_await_acknowledged(link_sent));
+            continue;
+        }
+        if (whatever_transmit(buf, n))
+            report_sender_error(LOG_ERR, "serial transmit failed");
+        link_sent += n;
+        spool_note_acked(whatever_acknowledged());
+    }
+    return NULL;
+}
+
+// Receivers see the reports; the spool watches for segment numbers.
+static void receive_output(const char *data, size_t count)
+{
+    broadcast_to_receivers(data, count);
+    spool_scan_reports(data, count);
+}
+
 static void *receive_thread_main(void *p)
 {
     while (true) {
         char buf[TTY_BUFSIZ];
         ssize_t nr = whatever_receive(buf, sizeof buf);
         if (nr > 0)
-            broadcast_to_receivers(buf, nr);
+            decode_reports(buf, nr, receive_output);
         if (nr == 0) {
             pthread_mutex_lock(&daemon_state.ds_lock);
             daemon_state.ds_serial = SS_FAILED;
@@ -343,6 +426,7 @@ static int create_IO_threads(void)
     }    
 
     // Create receive thread.
+    reset_report_decoder();
     r = pthread_create(&receive_thread, NULL, receive_thread_main, NULL);
     if (r) {
         syslog(LOG_ERR, "can't create receive thread: %s", strerror(r));
@@ -380,6 +464,103 @@ static int destroy_IO_threads(void)
     return 0;
 }
 
+// Holding the daemon lock keeps the main thread from closing the
+// port during the write.  The send thread doesn't take the lock, so
+// control bytes never wait behind sender data.
+int transmit_control(const char *buf, size_t count)
+{
+    int r = 1;
+    pthread_mutex_lock(&daemon_state.ds_lock);
+    if (daemon_state.ds_serial == SS_OPEN)
+        r = whatever_transmit_urgent(buf, count);
+    pthread_mutex_unlock(&daemon_state.ds_lock);
+    return r;
+}
+
+// Tell the receivers how to resume or cancel an interrupted job.
+static void offer_job_resumption(void)
+{
+    char desc[200], msg[300];
+    spool_describe(desc, sizeof desc);
+    int n = snprintf(msg, sizeof msg,
+                     "[job %s; \"thruport control resume-job\" or "
+                     "\"thruport control cancel-job\"]\n", desc);
+    if (n > 0 && (size_t)n < sizeof msg)
+        broadcast_to_receivers(msg, n);
+}
+
+int describe_jobs(char *msg, size_t size)
+{
+    char desc[200];
+    spool_describe(desc, sizeof desc);
+    unsigned int id = active_sender_id();
+    int n;
+    if (get_spool_state() == SPS_IDLE)
+        n = 0;
+    else if (id)
+        n = snprintf(msg, size, "job %u: %s\n", id, desc);
+    else
+        n = snprintf(msg, size, "job: %s\n", desc);
+    if (n < 0 || (size_t)n >= size)
+        n = 0;
+    if (list_waiting_senders(msg + n, size - n) == 0 && n == 0)
+        snprintf(msg, size, "no jobs\n");
+    return 0;
+}
+
+// Say whether the link, the back end, or the sender is the
+// bottleneck.
+static const char *bottleneck(const serial_stats *sp)
+{
+    if (sp->ss_tx_secs < sp->ss_open_secs / 2)
+        return "sender (the link is mostly idle)";
+    if (sp->ss_credit_wait_secs > sp->ss_outq_wait_secs &&
+        sp->ss_credit_wait_secs > sp->ss_tx_secs / 4)
+        return "back end (waiting for flow control credit)";
+    if (sp->ss_outq_wait_secs > sp->ss_tx_secs / 4)
+        return "serial link";
+    return "none";
+}
+
+int describe_stats(char *msg, size_t size)
+{
+    if (use_fwsim) {
+        snprintf(msg, size, "receivers dropped: %zu\n"
+                 "no link statistics with the simulator\n",
+                 receiver_drop_count());
+        return 0;
+    }
+    serial_stats st;
+    serial_get_stats(&st);
+    double rate = st.ss_tx_secs ? st.ss_tx_bytes / st.ss_tx_secs : 0;
+    snprintf(msg, size,
+             "link up %.1f s; sent %zu bytes, %.0f bytes/s "
+             "while sending (%.0f%% of %d)\n"
+             "credit starvation: %.2f s in %u waits, longest %.3f s\n"
+             "UART queue waits: %.2f s\n"
+             "received %zu bytes, %zu after flow control\n"
+             "control bytes sent: %zu\n"
+             "receivers dropped: %zu\n"
+             "bottleneck: %s\n",
+             st.ss_open_secs, st.ss_tx_bytes, rate,
+             100 * rate / SERIAL_BYTES_PER_SEC, SERIAL_BYTES_PER_SEC,
+             st.ss_credit_wait_secs, st.ss_credit_waits,
+             st.ss_credit_wait_max,
+             st.ss_outq_wait_secs,
+             st.ss_rx_raw_bytes, st.ss_rx_bytes,
+             st.ss_urgent_bytes,
+             receiver_drop_count(),
+             st.ss_tx_bytes ? bottleneck(&st) : "nothing sent yet");
+    return 0;
+}
+
+int cancel_job(char *msg, size_t size)
+{
+    int r = spool_cancel(msg, size);
+    stop_sender_input();
+    return r;
+}
+
 int suspend_daemon(void)
 {
     pthread_mutex_lock(&daemon_state.ds_lock);
@@ -422,14 +603,22 @@ static void run_daemon(const char *fwsim)
     }
     if (init_service())
         exit(EXIT_FAILURE);
+    if (init_spool())
+        exit(EXIT_FAILURE);
+    int r = pthread_create(&spool_thread, NULL, spool_thread_main, NULL);
+    if (r) {
+        syslog(LOG_ERR, "can't create spool thread: %s", strerror(r));
+        exit(EXIT_FAILURE);
+    }
 
     pthread_mutex_lock(&daemon_state.ds_lock);
     while (true) {
         bool use_timeout = false;
         if (daemon_state.ds_serial == SS_FAILED) {
             destroy_IO_threads();
+            if (spool_interrupt(whatever_acknowledged()))
+                message_sender("serial port failure; job spooled");
             close_whatever();
-            disconnect_sender("serial port failure");
             const char msg[] = "[serial disconnect]\n";
             broadcast_to_receivers(msg, sizeof msg - 1);
             daemon_state.ds_serial = SS_CLOSED;
@@ -438,9 +627,12 @@ static void run_daemon(const char *fwsim)
             if (daemon_state.ds_serial != SS_CLOSED) {
                 destroy_IO_threads();
                 close_whatever();
-                disconnect_sender("suspended");
                 daemon_state.ds_serial = SS_CLOSED;
             }
+            if (get_spool_state() != SPS_IDLE) {
+                message_sender("suspended");
+                cancel_job(NULL, 0);
+            }
             pthread_cond_signal(&daemon_state.ds_suspender_cond);
         } else if (daemon_state.ds_serial == SS_CLOSED) {
             if (open_whatever() == 0) {
@@ -455,6 +647,8 @@ static void run_daemon(const char *fwsim)
                     const char msg[] = "[serial reconnect]\n";
                     broadcast_to_receivers(msg, sizeof msg - 1);
                 }
+                if (get_spool_state() == SPS_INTERRUPTED)
+                    offer_job_resumption();
             } else {
                 // failed
                 use_timeout = true;
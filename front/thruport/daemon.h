@@ -2,6 +2,7 @@
 #define DAEMON_included
 
 #include <stdbool.h>
+#include <stddef.h>
 
 // Start daemon in background; current process need not exit.
 extern int spawn_daemon(void);
@@ -12,4 +13,18 @@ extern int start_daemon(bool debug, const char *fwsim);
 extern int suspend_daemon(void);
 extern int resume_daemon(void);
 
+// Send control bytes to the back end ahead of any sender data.
+// Returns nonzero if the serial port is not open or the write fails.
+extern int transmit_control(const char *buf, size_t count);
+
+// Describe the spooled job and the queued jobs, one per line.
+extern int describe_jobs(char *msg, size_t size);
+
+// Describe the serial link's throughput and stalls.
+extern int describe_stats(char *msg, size_t size);
+
+// Cancel the spooled job and disconnect its sender.  msg gets a
+// description for the user.
+extern int cancel_job(char *msg, size_t size);
+
 #endif /* !DAEMON_included */
@@ -33,6 +33,19 @@ ssize_t read_line(int fd, char *buf, size_t max)
     return i;
 }
 
+// Returns -1 on error, 0 on success.
+int write_all(int fd, const char *buf, size_t count)
+{
+    while (count) {
+        ssize_t nw = write(fd, buf, count);
+        if (nw < 0)
+            return -1;
+        buf += nw;
+        count -= nw;
+    }
+    return 0;
+}
+
 // XXX implement highlighting (colorizing).
 
 const char *char_repr(int c, bool highlighted)
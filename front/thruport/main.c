@@ -1,10 +1,10 @@
-#include <assert.h>
 #include <getopt.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "controller_client.h"
 #include "daemon.h"
 #include "paths.h"
 #include "receiver_client.h"
@@ -24,18 +24,43 @@ static void usage(FILE *out) __attribute__((noreturn));
 ///////////////////////////////////////////////////////////////////////////////
 // Control Main and Control Options
 
-// static const struct option control_options[] = {
-//     {  NULL,                            0, NULL,  0  }
-// };
+static const struct option control_options[] = {
+    {  NULL,                            0, NULL,  0  }
+};
 
 static const char *control_options_usage = 
-    "Control Options:\n"
-    "  (TBD)\n"
+    "Control Commands:\n"
+    "  stop                Emergency stop.\n"
+    "  hold                Feed hold: stop motion, keep queued work.\n"
+    "  resume              Resume after a hold.\n"
+    "  feed=100            Reset feed override to 100%.\n"
+    "  feed+10, feed-10    Adjust feed override by 10%.\n"
+    "  feed+1, feed-1      Adjust feed override by 1%.\n"
+    "  jobs                List the spooled job and queued jobs.\n"
+    "  resume-job          Resume a job interrupted by a serial failure.\n"
+    "  cancel-job          Cancel the spooled job.\n"
+    "  stats               Show serial link throughput and stalls.\n"
     "\n";
 
 static int control_main(int argc, char *argv[])
 {
-    assert(false && "XXX Write me!");
+    optind = 1;
+    while (true) {
+        int c = getopt_long(argc, argv, "", control_options, NULL);
+        if (c == -1)
+            break;
+
+        switch (c) {
+
+        default:
+            usage(stderr);
+        }
+    }
+    if (optind >= argc)
+        usage(stderr);
+
+    const char **commands = (const char **)argv + optind;
+    return be_controller(commands);
 }
 
 
@@ -213,7 +238,7 @@ static void usage(FILE *out)
 {
     // XXX refactor the usage message out into the modes' sections.
     static const char *msg =
-        "Use: thruport [options] control [control-options]\n"
+        "Use: thruport [options] control [control-options] command...\n"
         "     thruport [options] send    [send-options]    [file...]\n"
         "     thruport [options] receive [receive-options]\n"
         "     thruport [options] suspend [suspend-options] program args...\n"
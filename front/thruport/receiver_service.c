@@ -1,6 +1,8 @@
 #include "receiver_service.h"
 
 #include <assert.h>
+#include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -17,10 +19,13 @@ typedef struct receiver {
 static receiver *receivers = NULL;
 static size_t receiver_count = 0;
 static size_t receiver_max = 0;
+static size_t receivers_dropped = 0;
 
-// XXX need locking of receiver array.
-//     the client starter thread appends to it (and realocates it),
-//     and the receiver thread iterates through it.
+// receiver_lock guards the receiver array and receivers_dropped.
+// The client starter thread appends to the array (and reallocates
+// it), the receiver thread iterates through it, and the control
+// thread reads the drop count.
+static pthread_mutex_t receiver_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static receiver *alloc_receiver(void)
 {
@@ -48,8 +53,10 @@ static void free_receiver(receiver *r)
 
 void instantiate_receiver_service(int sock)
 {
+    pthread_mutex_lock(&receiver_lock);
     receiver *r = alloc_receiver();
     r->r_fd = sock;
+    pthread_mutex_unlock(&receiver_lock);
 #ifdef SO_NOSIGPIPE
     // Suppress SIGPIPE.
     int set = 1;
@@ -77,14 +84,35 @@ static int send_to_receiver(receiver *r, const char *data, size_t count)
     return 0;
 }
 
+static void unlock(void *arg)
+{
+    pthread_mutex_unlock(arg);
+}
+
+// send() is a cancellation point, and the receive thread is cancelled
+// when the port is suspended.
 void broadcast_to_receivers(const char *data, size_t count)
 {
-    receiver *r = receivers;
-    while (r < receivers + receiver_count) {
-        if (send_to_receiver(r, data, count)) {
-            (void)close(r->r_fd);
-            free_receiver(r);
-        } else
-            r++;
-    }
+    pthread_mutex_lock(&receiver_lock);
+    pthread_cleanup_push(unlock, &receiver_lock); {
+        receiver *r = receivers;
+        while (r < receivers + receiver_count) {
+            if (send_to_receiver(r, data, count)) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    receivers_dropped++;
+                (void)close(r->r_fd);
+                free_receiver(r);
+            } else
+                r++;
+        }
+    } pthread_cleanup_pop(1);
+}
+
+// Receivers dropped because they didn't keep up.
+size_t receiver_drop_count(void)
+{
+    pthread_mutex_lock(&receiver_lock);
+    size_t dropped = receivers_dropped;
+    pthread_mutex_unlock(&receiver_lock);
+    return dropped;
 }
@@ -7,5 +7,7 @@ extern void instantiate_receiver_service(int sock);
 
 extern void broadcast_to_receivers(const char *data, size_t count);
 
+extern size_t receiver_drop_count(void);
+
 #endif /* !RECEIVER_SERVICE_included */
  
@@ -0,0 +1,406 @@
+#include "report_decoder.h"
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <syslog.h>
+
+#include "config/proto-defs.h"
+
+// The frame layout must match back/report.c.
+
+#define FRAME_START  0xC0
+#define FRAME_END    0xC1
+#define PAYLOAD_MAX  256
+
+#define EOL "\r\n"              // the firmware's line ending
+
+// Type codes must match enum variable_type in back/variables.h.
+#define VT_UNSIGNED 026
+#define VT_SIGNED   023
+#define VT_ENUM     005
+
+static const char fault_names[][FAULT_NAME_SIZE] = FAULT_NAMES_INIT;
+static const size_t fault_count = sizeof fault_names / sizeof fault_names[0];
+
+static const char var_descs[][VAR_DESC_SIZE] = VARIABLE_DESCRIPTORS_INIT;
+static const size_t var_count = sizeof var_descs / sizeof var_descs[0];
+
+static struct decoder_state {
+    bool     ds_in_frame;
+    bool     ds_skipping;       // rest of a truncated frame
+    uint16_t ds_bits;
+    uint8_t  ds_nbits;
+    bool     ds_overflow;
+    size_t   ds_size;
+    uint8_t  ds_payload[PAYLOAD_MAX];
+    bool     ds_seq_known;
+    uint8_t  ds_next_seq;
+} decoder;
+
+// Payload reader.  Reading past the end sets pr_error and returns 0.
+
+typedef struct payload_reader {
+    const uint8_t *pr_pos;
+    const uint8_t *pr_end;
+    bool           pr_error;
+} payload_reader;
+
+static uint8_t get_u8(payload_reader *rp)
+{
+    if (rp->pr_pos < rp->pr_end)
+        return *rp->pr_pos++;
+    rp->pr_error = true;
+    return 0;
+}
+
+static uint16_t get_u16(payload_reader *rp)
+{
+    uint16_t lo = get_u8(rp);
+    return lo | get_u8(rp) << 8;
+}
+
+static uint32_t get_u32(payload_reader *rp)
+{
+    uint32_t lo = get_u16(rp);
+    return lo | (uint32_t)get_u16(rp) << 16;
+}
+
+// Text buffer for one decoded frame.
+
+typedef struct text_buf {
+    char   tb_buf[8192];
+    size_t tb_size;
+} text_buf;
+
+__attribute__((format(printf, 2, 3)))
+static void append(text_buf *tp, const char *fmt, ...)
+{
+    size_t room = sizeof tp->tb_buf - tp->tb_size;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(tp->tb_buf + tp->tb_size, room, fmt, ap);
+    va_end(ap);
+    if (n > 0)
+        tp->tb_size += (size_t)n < room ? (size_t)n : room - 1;
+}
+
+static inline char yes_no(uint8_t bits, int bit)
+{
+    return bits & 1 << bit ? 'y' : 'n';
+}
+
+static char switch_state(uint8_t present, uint8_t reached, int bit)
+{
+    return present & 1 << bit ? yes_no(reached, bit) : '_';
+}
+
+static void decode_positions(payload_reader *rp, text_buf *tp)
+{
+    int32_t x = get_u32(rp);
+    int32_t y = get_u32(rp);
+    int32_t z = get_u32(rp);
+    append(tp, "A x=%+"PRId32" y=%+"PRId32" z=%+"PRId32 EOL, x, y, z);
+}
+
+static void decode_e_stop(payload_reader *rp, text_buf *tp)
+{
+    uint8_t b = get_u8(rp);
+    append(tp, "E o=%c b=%c l=%c v=%c m=%c" EOL,
+           yes_no(b, 0), yes_no(b, 1), yes_no(b, 2),
+           yes_no(b, 3), yes_no(b, 4));
+}
+
+static void decode_faults(payload_reader *rp, text_buf *tp)
+{
+    uint16_t faults = get_u16(rp);
+    append(tp, "F");
+    for (size_t i = 0; i < fault_count; i++)
+        if (faults & 1 << i)
+            append(tp, " %s", fault_names[i]);
+    append(tp, EOL);
+}
+
+static void decode_limit_switches(payload_reader *rp, text_buf *tp)
+{
+    uint8_t p = get_u8(rp);
+    uint8_t r = get_u8(rp);
+    append(tp, "L x=%c%c y=%c%c z=%c%c" EOL,
+           switch_state(p, r, 0), switch_state(p, r, 1),
+           switch_state(p, r, 2), switch_state(p, r, 3),
+           switch_state(p, r, 4), switch_state(p, r, 5));
+}
+
+static void decode_motors(payload_reader *rp, text_buf *tp)
+{
+    uint8_t b = get_u8(rp);
+    append(tp, "M x=%c%c y=%c%c z=%c%c" EOL,
+           b & 1 << 0 ? 'e' : 'd', b & 1 << 1 ? '+' : '-',
+           b & 1 << 2 ? 'e' : 'd', b & 1 << 3 ? '+' : '-',
+           b & 1 << 4 ? 'e' : 'd', b & 1 << 5 ? '+' : '-');
+}
+
+static void decode_segments(payload_reader *rp, text_buf *tp)
+{
+    unsigned n = get_u16(rp);
+    unsigned c = get_u16(rp);
+    append(tp, "N n=%u c=%u" EOL, n, c);
+}
+
+static void decode_overrides(payload_reader *rp, text_buf *tp)
+{
+    unsigned f = get_u8(rp);
+    char h = get_u8(rp);
+    append(tp, "O f=%u h=%c" EOL, f, h);
+}
+
+static void decode_power(payload_reader *rp, text_buf *tp)
+{
+    uint8_t b = get_u8(rp);
+    append(tp, "P le=%c lr=%c he=%c ae=%c we=%c" EOL,
+           yes_no(b, 0), yes_no(b, 1), yes_no(b, 2),
+           yes_no(b, 3), yes_no(b, 4));
+}
+
+static void decode_queues(payload_reader *rp, text_buf *tp)
+{
+    unsigned x = get_u8(rp);
+    unsigned y = get_u8(rp);
+    unsigned z = get_u8(rp);
+    unsigned p = get_u8(rp);
+    append(tp, "Q x=%u y=%u z=%u p=%u" EOL, x, y, z, p);
+}
+
+static void decode_RAM(payload_reader *rp, text_buf *tp)
+{
+    unsigned t = get_u16(rp);
+    unsigned d = get_u16(rp);
+    unsigned b = get_u16(rp);
+    unsigned f = get_u16(rp);
+    unsigned s = get_u16(rp);
+    append(tp, "R t=%u d=%u b=%u f=%u s=%u" EOL, t, d, b, f, s);
+}
+
+static void decode_serial(payload_reader *rp, text_buf *tp)
+{
+    unsigned rc = get_u8(rp);
+    unsigned rl = get_u8(rp);
+    unsigned re = get_u8(rp);
+    unsigned tc = get_u8(rp);
+    unsigned te = get_u8(rp);
+    append(tp, "S rx c=%u l=%u e=%#x, tx c=%u e=%#x" EOL,
+           rc, rl, re, tc, te);
+}
+
+static void decode_timing(payload_reader *rp, text_buf *tp)
+{
+    uint8_t nh = get_u8(rp);
+    uint8_t nb = get_u8(rp);
+    append(tp, "T");
+    for (uint8_t i = 0; i < nh && !rp->pr_error; i++) {
+        append(tp, " %c=", get_u8(rp));
+        for (uint8_t j = 0; j < nb; j++) {
+            if (j)
+                append(tp, ",");
+            append(tp, "%u", get_u16(rp));
+        }
+    }
+    append(tp, EOL);
+}
+
+static void decode_variable(payload_reader *rp, text_buf *tp, size_t index)
+{
+    const char *desc = var_descs[index];
+    switch (desc[3]) {
+
+    case VT_UNSIGNED:
+        append(tp, " %.2s=%"PRIu32, desc, get_u32(rp));
+        break;
+
+    case VT_SIGNED:
+        append(tp, " %.2s=%+"PRId32, desc, (int32_t)get_u32(rp));
+        break;
+
+    case VT_ENUM:
+        append(tp, " %.2s=%c", desc, get_u8(rp));
+        break;
+
+    default:
+        rp->pr_error = true;
+        break;
+    }
+}
+
+// A snapshot has every variable.
+static void decode_variables(payload_reader *rp, text_buf *tp)
+{
+    if (get_u8(rp) != var_count) {
+        rp->pr_error = true;
+        return;
+    }
+    append(tp, "V");
+    for (size_t i = 0; i < var_count && !rp->pr_error; i++)
+        decode_variable(rp, tp, i);
+    append(tp, EOL);
+}
+
+// A delta has only the variables that changed.  It is decoded to the
+// same V line, listing fewer variables.
+static void decode_variable_changes(payload_reader *rp, text_buf *tp)
+{
+    uint8_t n = get_u8(rp);
+    append(tp, "V");
+    for (uint8_t i = 0; i < n && !rp->pr_error; i++) {
+        uint8_t index = get_u8(rp);
+        if (index >= var_count) {
+            rp->pr_error = true;
+            return;
+        }
+        decode_variable(rp, tp, index);
+    }
+    append(tp, EOL);
+}
+
+static void decode_unimplemented(payload_reader *rp, text_buf *tp)
+{
+    append(tp, "%c report not implemented" EOL, get_u8(rp));
+}
+
+static bool decode_payload(const uint8_t *payload, size_t size, text_buf *tp)
+{
+    uint8_t sum = 0;
+    for (size_t i = 0; i < size; i++)
+        sum += payload[i];
+    if (size < 2 || sum) {
+        syslog(LOG_WARNING, "status frame checksum error");
+        return false;
+    }
+
+    payload_reader r = { payload, payload + size - 1, false };
+    uint8_t seq = get_u8(&r);
+    if (decoder.ds_seq_known && seq != decoder.ds_next_seq)
+        syslog(LOG_WARNING, "%u status frames lost",
+               (uint8_t)(seq - decoder.ds_next_seq));
+    decoder.ds_seq_known = true;
+    decoder.ds_next_seq = seq + 1;
+
+    while (r.pr_pos < r.pr_end && !r.pr_error) {
+        uint8_t tag = get_u8(&r);
+        switch (tag) {
+        case 'A': decode_positions(&r, tp);        break;
+        case 'E': decode_e_stop(&r, tp);           break;
+        case 'F': decode_faults(&r, tp);           break;
+        case 'L': decode_limit_switches(&r, tp);   break;
+        case 'M': decode_motors(&r, tp);           break;
+        case 'N': decode_segments(&r, tp);         break;
+        case 'O': decode_overrides(&r, tp);        break;
+        case 'P': decode_power(&r, tp);            break;
+        case 'Q': decode_queues(&r, tp);           break;
+        case 'R': decode_RAM(&r, tp);              break;
+        case 'S': decode_serial(&r, tp);           break;
+        case 'T': decode_timing(&r, tp);           break;
+        case 'V': decode_variables(&r, tp);        break;
+        case 'v': decode_variable_changes(&r, tp); break;
+        case '?': decode_unimplemented(&r, tp);    break;
+
+        default:
+            r.pr_error = true;
+            break;
+        }
+    }
+    if (r.pr_error) {
+        syslog(LOG_WARNING, "malformed status frame");
+        return false;
+    }
+    append(tp, "---" EOL EOL);
+    return true;
+}
+
+static void begin_frame(void)
+{
+    decoder.ds_in_frame = true;
+    decoder.ds_skipping = false;
+    decoder.ds_bits = 0;
+    decoder.ds_nbits = 0;
+    decoder.ds_overflow = false;
+    decoder.ds_size = 0;
+}
+
+static void add_frame_bits(uint8_t c)
+{
+    decoder.ds_bits |= (c & 0x3F) << decoder.ds_nbits;
+    decoder.ds_nbits += 6;
+    if (decoder.ds_nbits >= 8) {
+        if (decoder.ds_size < PAYLOAD_MAX)
+            decoder.ds_payload[decoder.ds_size++] = decoder.ds_bits;
+        else
+            decoder.ds_overflow = true;
+        decoder.ds_bits >>= 8;
+        decoder.ds_nbits -= 8;
+    }
+}
+
+static void end_frame(report_output_func *output)
+{
+    static text_buf text;
+    decoder.ds_in_frame = false;
+    if (decoder.ds_overflow) {
+        syslog(LOG_WARNING, "status frame too long");
+        return;
+    }
+    text.tb_size = 0;
+    if (decode_payload(decoder.ds_payload, decoder.ds_size, &text))
+        (*output)(text.tb_buf, text.tb_size);
+}
+
+void reset_report_decoder(void)
+{
+    decoder.ds_in_frame = false;
+    decoder.ds_skipping = false;
+    decoder.ds_seq_known = false;
+}
+
+void decode_reports(const char         *data,
+                    size_t              count,
+                    report_output_func *output)
+{
+    const char *text = data;    // start of text not yet output
+    for (size_t i = 0; i < count; i++) {
+        uint8_t c = data[i];
+        if (c == FRAME_START) {
+            if (text < data + i)
+                (*output)(text, data + i - text);
+            if (decoder.ds_in_frame)
+                syslog(LOG_WARNING, "status frame truncated");
+            begin_frame();
+            text = data + i + 1;
+        } else if (decoder.ds_in_frame) {
+            if ((c & 0xC0) == 0x80) {
+                add_frame_bits(c);
+                text = data + i + 1;
+            } else if (c == FRAME_END) {
+                end_frame(output);
+                text = data + i + 1;
+            } else {
+                // Not a frame byte.  Drop the frame; keep the byte.
+                syslog(LOG_WARNING, "status frame truncated");
+                decoder.ds_in_frame = false;
+                decoder.ds_skipping = true;
+            }
+        } else if (decoder.ds_skipping) {
+            // Swallow the truncated frame's remaining payload bytes
+            // and its end byte.  Text still passes through.
+            if ((c & 0xC0) == 0x80 || c == FRAME_END) {
+                if (text < data + i)
+                    (*output)(text, data + i - text);
+                text = data + i + 1;
+                if (c == FRAME_END)
+                    decoder.ds_skipping = false;
+            }
+        }
+    }
+    if (text < data + count)
+        (*output)(text, data + count - text);
+}
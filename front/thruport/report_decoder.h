@@ -0,0 +1,17 @@
+#ifndef REPORT_DECODER_included
+#define REPORT_DECODER_included
+
+#include <stddef.h>
+
+// The firmware sends status reports as binary frames.  The report
+// decoder passes other data through unchanged and turns each frame
+// into the text lines the firmware used to print.
+
+typedef void report_output_func(const char *data, size_t count);
+
+extern void reset_report_decoder (void);
+extern void decode_reports       (const char         *data,
+                                  size_t              count,
+                                  report_output_func *output);
+
+#endif /* !REPORT_DECODER_included */
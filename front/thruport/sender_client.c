@@ -1,5 +1,6 @@
 #include "sender_client.h"
 
+#include <fcntl.h>
 #include <pthread.h>
 #include <signal.h>
 #include <stdbool.h>
@@ -7,29 +8,66 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 
 #include "client.h"
+#include "io.h"
+
+#define STREAM_BUFSIZ (64 * 1024)
 
 // Use two standard I/O streams on two descriptors so that there is no
 // contention between the threads.
 static FILE *sockrf, *sockwf;
 
+// Regular files are mapped and handed to the kernel whole, so even a
+// large job costs only a few writes.  Pipes, terminals, and files
+// that can't be mapped are copied through a large buffer; read()
+// returns whatever is available, so interactive input isn't delayed.
+//
 // Returns -1 on error, 0 on success.
-static int send_stream(FILE *f, const char *fname)
+static int send_fd(int fd, const char *fname)
 {
-    char line[BUFSIZ];
-    while (fgets(line, sizeof line, f)) {
-        if (fputs(line, sockwf) == EOF)
-            return -1;
+    int sock = fileno(sockwf);
+    struct stat s;
+    if (fstat(fd, &s) == 0 && S_ISREG(s.st_mode) && s.st_size > 0) {
+        void *map = mmap(NULL, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            (void)madvise(map, s.st_size, MADV_SEQUENTIAL);
+            int r = write_all(sock, map, s.st_size);
+            (void)munmap(map, s.st_size);
+            return r;
+        }
+    }
+    char *buf = malloc(STREAM_BUFSIZ);
+    if (!buf) {
+        perror(fname);
+        return -1;
     }
-    return ferror(f) ? -1 : 0;
+    int r = 0;
+    while (true) {
+        ssize_t nr = read(fd, buf, STREAM_BUFSIZ);
+        if (nr < 0) {
+            perror(fname);
+            r = -1;
+            break;
+        }
+        if (nr == 0)
+            break;
+        if (write_all(sock, buf, nr)) {
+            r = -1;
+            break;
+        }
+    }
+    free(buf);
+    return r;
 }
 
 // Returns -1 on error, 0 on success.
 static int send_stdin(void)
 {
-    return send_stream(stdin, "Standard input");
+    return send_fd(STDIN_FILENO, "Standard input");
 }
 
 // Returns -1 on error, 0 on success.
@@ -37,13 +75,13 @@ static int send_file(const char *file)
 {
     if (strcmp(file, "-") == 0)
         return send_stdin();
-    FILE *f = fopen(file, "r");
-    if (!f) {
+    int fd = open(file, O_RDONLY);
+    if (fd < 0) {
         perror(file);
         return -1;
     }
-    int r = send_stream(f, file);
-    fclose(f);
+    int r = send_fd(fd, file);
+    close(fd);
     return r;
 }
 
@@ -1,6 +1,7 @@
 #include "sender_service.h"
 
 #include <errno.h>
+#include <fcntl.h>
 #include <pthread.h>
 #include <stdarg.h>
 #include <stdbool.h>
@@ -8,13 +9,28 @@
 #include <stdlib.h>
 #include <string.h>
 #include <syslog.h>
+#include <time.h>
 #include <unistd.h>
+#include <sys/socket.h>
+
+// Senders wait in a FIFO queue.  The sender at the head is active:
+// the spool thread reads its job.  The others are not read at all
+// until they reach the head, so their jobs can't interleave.
+
+typedef struct sender {
+    struct sender *s_next;
+    unsigned int   s_id;
+    int            s_sock;
+    FILE          *s_fout;
+    time_t         s_queued;
+} sender;
 
 static pthread_mutex_t sslock = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t  sscond = PTHREAD_COND_INITIALIZER;
+static sender         *queue_head;
+static sender        **queue_tail = &queue_head;
 static bool            sender_active;
-static int             sender_sock;
-static FILE           *sender_fout;
+static unsigned int    next_id = 1;
 
 __attribute__((format (printf, 3, 4)))
 static void fail_sender(int sock, int priority, const char *fmt, ...)
@@ -40,18 +56,16 @@ static void fail_sender(int sock, int priority, const char *fmt, ...)
 
 void instantiate_sender_service(int sock)
 {
-    pthread_mutex_lock(&sslock);
-    bool a = sender_active;
-    pthread_mutex_unlock(&sslock);
-
-    if (a) {
-        fail_sender(sock, LOG_ERR, "another sender is already active");
+    sender *sp = malloc(sizeof *sp);
+    if (!sp) {
+        fail_sender(sock, LOG_ERR, "out of memory");
         close(sock);
         return;
     }
-    int sock2 = dup(sock);
+    int sock2 = fcntl(sock, F_DUPFD_CLOEXEC, 0);
     if (sock2 < 0) {
         fail_sender(sock, LOG_ERR, "failed to dup sender socket: %m");
+        free(sp);
         close(sock);
         return;
     }
@@ -59,16 +73,23 @@ void instantiate_sender_service(int sock)
     FILE *fsock_out = fdopen(sock2, "w");
     if (fsock_out == NULL) {
         fail_sender(sock, LOG_ERR, "failed to fdopen sender socket: %m");
+        free(sp);
         close(sock2);
         close(sock);
         return;
     }
     setbuf(fsock_out, NULL);
 
+    sp->s_next = NULL;
+    sp->s_sock = sock;
+    sp->s_fout = fsock_out;
+    sp->s_queued = time(NULL);
     pthread_mutex_lock(&sslock);
-    sender_sock = sock;
-    sender_fout = fsock_out;
-    sender_active = true;
+    sp->s_id = next_id++;
+    *queue_tail = sp;
+    queue_tail = &sp->s_next;
+    if (sp != queue_head)
+        syslog(LOG_INFO, "job %u queued", sp->s_id);
     pthread_cond_signal(&sscond);
     pthread_mutex_unlock(&sslock);
 }
@@ -77,12 +98,15 @@ void disconnect_sender(const char *reason)
 {
     pthread_mutex_lock(&sslock);
     if (sender_active) {
+        sender *sp = queue_head;
         if (reason)
-            fprintf(sender_fout, "thruport: %s\n", reason);
-        fclose(sender_fout);
-        close(sender_sock);
-        sender_sock = -1;
-        sender_fout = NULL;
+            fprintf(sp->s_fout, "thruport: %s\n", reason);
+        fclose(sp->s_fout);
+        close(sp->s_sock);
+        queue_head = sp->s_next;
+        if (!queue_head)
+            queue_tail = &queue_head;
+        free(sp);
         sender_active = false;
     }
     pthread_mutex_unlock(&sslock);
@@ -94,17 +118,19 @@ static void unlock(void *arg)
     pthread_mutex_unlock(mutex);
 }
 
-// Because await_sender_socket() is called from the sender thread, and
-// the sender thread can be cancelled, we must wrap the mutex lock
-// with a pthread_cleanup function.
+// Because await_sender_socket() is called from the spool thread, and
+// the thread could be cancelled, we must wrap the mutex lock with a
+// pthread_cleanup function.
 int await_sender_socket(void)
 {
     int sock;
     pthread_mutex_lock(&sslock);
     pthread_cleanup_push(unlock, &sslock); {
-        while (!sender_active)
+        while (!queue_head)
             pthread_cond_wait(&sscond, &sslock);
-        sock = sender_sock;
+        sender_active = true;
+        sock = queue_head->s_sock;
+        syslog(LOG_INFO, "job %u started", queue_head->s_id);
     } pthread_cleanup_pop(1);
     return sock;
 }
@@ -114,10 +140,57 @@ void report_sender_error(int priority, const char *msg)
     int e = errno;              // copy in case syscalls below modify it.
     syslog(priority, "%s: %m", msg);
     pthread_mutex_lock(&sslock);
-    FILE *fout = sender_fout;
+    FILE *fout = sender_active ? queue_head->s_fout : NULL;
     pthread_mutex_unlock(&sslock);
     if (fout) {
         fprintf(fout, "%s: %s\n", msg, strerror(e));
         fflush(fout);
     }
 }
+
+void message_sender(const char *msg)
+{
+    pthread_mutex_lock(&sslock);
+    if (sender_active)
+        fprintf(queue_head->s_fout, "thruport: %s\n", msg);
+    pthread_mutex_unlock(&sslock);
+}
+
+// Wake the spool thread if it is waiting for the sender.
+void stop_sender_input(void)
+{
+    pthread_mutex_lock(&sslock);
+    if (sender_active)
+        (void)shutdown(queue_head->s_sock, SHUT_RD);
+    pthread_mutex_unlock(&sslock);
+}
+
+unsigned int active_sender_id(void)
+{
+    pthread_mutex_lock(&sslock);
+    unsigned int id = sender_active ? queue_head->s_id : 0;
+    pthread_mutex_unlock(&sslock);
+    return id;
+}
+
+size_t list_waiting_senders(char *buf, size_t size)
+{
+    size_t len = 0;
+    time_t now = time(NULL);
+    buf[0] = '\0';
+    pthread_mutex_lock(&sslock);
+    for (sender *sp = queue_head; sp; sp = sp->s_next) {
+        if (sp == queue_head && sender_active)
+            continue;
+        int n = snprintf(buf + len, size - len,
+                         "job %u: waiting for %ld seconds\n",
+                         sp->s_id, (long)(now - sp->s_queued));
+        if (n < 0 || (size_t)n >= size - len) {
+            buf[len] = '\0';
+            break;
+        }
+        len += n;
+    }
+    pthread_mutex_unlock(&sslock);
+    return len;
+}
@@ -1,10 +1,19 @@
 #ifndef SENDER_SERVICE_included
 #define SENDER_SERVICE_included
 
+#include <stddef.h>
+
 extern void  instantiate_sender_service (int sock);
 extern void  disconnect_sender          (const char *reason);
 
 extern int   await_sender_socket        (void);
 extern void  report_sender_error        (int priority, const char *msg);
+extern void  message_sender             (const char *msg);
+extern void  stop_sender_input          (void);
+
+// Senders wait in a FIFO queue.  Jobs are numbered from 1; 0 means
+// no sender is active.
+extern unsigned int active_sender_id    (void);
+extern size_t list_waiting_senders      (char *buf, size_t size);
 
 #endif /* !SENDER_SERVICE_included */
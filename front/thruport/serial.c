@@ -1,16 +1,38 @@
 #include "serial.h"
 
+#include <errno.h>
 #include <pthread.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <syslog.h>
 #include <termios.h>
+#include <time.h>
 #include <sys/fcntl.h>
+#include <sys/ioctl.h>
 
 #include "debug.h"
 #include "io.h"
 #include "lock.h"
 #include "paths.h"
 
+// The bulk lane writes at most TX_CHUNK bytes at a time, and only
+// when the kernel's output queue has no more than TX_OUTQ_MAX bytes
+// in it.  An urgent byte written between chunks waits behind at most
+// TX_OUTQ_MAX + TX_CHUNK bytes, about 5.5 msec at 115200 baud.
+#define TX_CHUNK         32
+#define TX_OUTQ_MAX      32
+#define USEC_PER_BYTE    87     // 10 bits at 115200 baud
+
+// Flow control.  These must match back/serial.c.  Credit bytes carry
+// the high nibble of the back end's RX head, so they only make sense
+// once both ends count from the same place.  After the port opens,
+// the back end may still hold bytes from before, so credit is ignored
+// and nothing is sent until the back end says its RX buffer is empty
+// and at 0 (CREDIT_SYNC).  It says so at startup, and when asked.
+#define RT_SYNC_CREDIT   '\x87'
+#define CREDIT_SYNC      0xE0
+
 static struct termios  orig_termios, raw_termios;
 static size_t          tty_bufsize;
 static char           *tty_rawbuf;
@@ -19,6 +41,9 @@ static int             ttyfd = -1;
 static pthread_mutex_t serial_lock = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t  serial_cond = PTHREAD_COND_INITIALIZER;
 static size_t          tx_sent, tx_received, tx_space;
+static bool            credit_synced;
+static serial_stats    stats;
+static double          open_time;
 
 #include <stdio.h>
 
@@ -40,6 +65,13 @@ static void make_raw(struct termios *tiosp)
 }
 
 
+static double now_secs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
 int init_serial(void)
 {
     // Register handlers.
@@ -90,8 +122,18 @@ int open_serial(void)
         exit(EXIT_FAILURE);
     }
 
-    // Init flow control.
+    // Init flow control and statistics.
+    pthread_mutex_lock(&serial_lock);
     tx_sent = tx_received = tx_space = 0;
+    credit_synced = false;
+    memset(&stats, 0, sizeof stats);
+    open_time = now_secs();
+    pthread_mutex_unlock(&serial_lock);
+
+    // If the back end didn't restart, ask where its RX buffer is.
+    static const char sync = RT_SYNC_CREDIT;
+    if (serial_transmit_urgent(&sync, 1))
+        syslog(LOG_ERR, "can't request flow control credit: %m");
 
     return 0;
 }
@@ -109,17 +151,70 @@ void close_serial(void)
     }
 }
 
+// Wait until the kernel's output queue is shallow.  Returns the
+// time spent waiting.
+static double await_shallow_outq(void)
+{
+    double t0 = 0;
+    while (true) {
+        int outq;
+        if (ioctl(ttyfd, TIOCOUTQ, &outq) < 0 || outq <= TX_OUTQ_MAX)
+            return t0 ? now_secs() - t0 : 0;
+        if (!t0)
+            t0 = now_secs();
+        usleep((outq - TX_OUTQ_MAX) * USEC_PER_BYTE);
+    }
+}
+
+static void unlock(void *arg)
+{
+    pthread_mutex_unlock(arg);
+}
+
+// Called with serial_lock held.  The send thread is usually waiting
+// here when the port fails and the thread is cancelled, so the lock
+// must not go with it.  (serial_transmit() drops the lock around its
+// other cancellation points.)
+static void await_credit(void)
+{
+    if (tx_space)
+        return;
+    double t0 = now_secs();
+    pthread_cleanup_push(unlock, &serial_lock); {
+        while (!tx_space)
+            pthread_cond_wait(&serial_cond, &serial_lock);
+    } pthread_cleanup_pop(0);
+    double wait = now_secs() - t0;
+    stats.ss_credit_waits++;
+    stats.ss_credit_wait_secs += wait;
+    if (stats.ss_credit_wait_max < wait)
+        stats.ss_credit_wait_max = wait;
+}
+
+// An urgent byte on the bulk lane would run a real-time command and
+// use up a byte of credit the back end never returns.
 int serial_transmit(const char *buf, size_t size)
 {
+    for (size_t i = 0; i < size; i++)
+        if (serial_is_urgent_char(buf[i])) {
+            errno = EINVAL;
+            return 1;
+        }
+    double t0 = now_secs();
     pthread_mutex_lock(&serial_lock);
     while (size) {
-        while (!tx_space)
-            pthread_cond_wait(&serial_cond, &serial_lock);
+        await_credit();
         size_t ntw = tx_space;
         if (ntw > size)
             ntw = size;
+        if (ntw > TX_CHUNK)
+            ntw = TX_CHUNK;
         tx_sent += ntw;
         tx_space -= ntw;
+        pthread_mutex_unlock(&serial_lock);
+        double outq_wait = await_shallow_outq();
+        pthread_mutex_lock(&serial_lock);
+        stats.ss_outq_wait_secs += outq_wait;
         while (ntw) {
             pthread_mutex_unlock(&serial_lock);
             ssize_t nw = write(ttyfd, buf, ntw);
@@ -127,22 +222,82 @@ int serial_transmit(const char *buf, size_t size)
             if (nw < 0) {
                 tx_sent -= ntw;
                 tx_space += ntw;
+                stats.ss_tx_secs += now_secs() - t0;
                 pthread_mutex_unlock(&serial_lock);
                 return 1;
             }
+            stats.ss_tx_bytes += nw;
             ntw -= nw;
             size -= nw;
             buf += nw;
         }
     }
+    stats.ss_tx_secs += now_secs() - t0;
     pthread_mutex_unlock(&serial_lock);
     return 0;
 }
 
+int serial_transmit_urgent(const char *buf, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+        if (!serial_is_urgent_char(buf[i])) {
+            errno = EINVAL;
+            return 1;
+        }
+    while (size) {
+        ssize_t nw = write(ttyfd, buf, size);
+        if (nw < 0)
+            return 1;
+        pthread_mutex_lock(&serial_lock);
+        stats.ss_urgent_bytes += nw;
+        pthread_mutex_unlock(&serial_lock);
+        size -= nw;
+        buf += nw;
+    }
+    return 0;
+}
+
+size_t serial_acknowledged(void)
+{
+    pthread_mutex_lock(&serial_lock);
+    size_t received = tx_received;
+    pthread_mutex_unlock(&serial_lock);
+    return received;
+}
+
+size_t serial_await_acknowledged(size_t count)
+{
+    size_t received;
+    pthread_mutex_lock(&serial_lock);
+    pthread_cleanup_push(unlock, &serial_lock); {
+        while ((ptrdiff_t)(tx_received - count) < 0)
+            pthread_cond_wait(&serial_cond, &serial_lock);
+        received = tx_received;
+    } pthread_cleanup_pop(1);
+    return received;
+}
+
 static inline bool eat_flow_char(char c)
 {
+    if ((uint8_t)c == CREDIT_SYNC) {
+        // Only the first counts.  A second answers a request that
+        // crossed the back end's startup message.
+        pthread_mutex_lock(&serial_lock);
+        if (!credit_synced) {
+            credit_synced = true;
+            tx_sent = tx_received = 0;
+            tx_space = 0xFF;
+            pthread_cond_signal(&serial_cond);
+        }
+        pthread_mutex_unlock(&serial_lock);
+        return true;
+    }
     if ((c & 0xF0) == 0xF0) {
         pthread_mutex_lock(&serial_lock);
+        if (!credit_synced) {
+            pthread_mutex_unlock(&serial_lock);
+            return true;
+        }
         size_t olo = tx_received & 0xFF;
         size_t ohi = tx_received & ~0xFF;
         size_t nlo = (size_t)(c & 0x0F) << 4;
@@ -184,11 +339,20 @@ ssize_t serial_receive(char *buf, size_t max)
             return nread;
         } else {
             size_t ncanon = cook_chars(buf, tty_rawbuf, nread);
-            static size_t raw_tot = 0, can_tot = 0;
-            raw_tot += nread; can_tot += ncanon;
+            pthread_mutex_lock(&serial_lock);
+            stats.ss_rx_raw_bytes += nread;
+            stats.ss_rx_bytes += ncanon;
+            pthread_mutex_unlock(&serial_lock);
             if (ncanon > 0)
                 return ncanon;
         }
     }
 }
 
+void serial_get_stats(serial_stats *sp)
+{
+    pthread_mutex_lock(&serial_lock);
+    *sp = stats;
+    sp->ss_open_secs = open_time ? now_secs() - open_time : 0;
+    pthread_mutex_unlock(&serial_lock);
+}
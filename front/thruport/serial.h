@@ -1,16 +1,59 @@
 #ifndef SERIAL_included
 #define SERIAL_included
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <unistd.h>
 
 #define TTY_BUFSIZ 256
 
-extern int     init_serial     (void);
-extern int     open_serial     (void);
-extern void    close_serial    (void);
+extern int     init_serial            (void);
+extern int     open_serial            (void);
+extern void    close_serial           (void);
 
-extern int     serial_transmit (const char *buf, size_t count);
-extern ssize_t serial_receive  (      char *buf, size_t max);
+// There are two transmit lanes.  The bulk lane carries the sender's
+// data and waits for flow control credit.  The urgent lane carries
+// control bytes, which the back end handles in its receive interrupt
+// and never buffers, so they are sent at once without credit.  Each
+// lane rejects the other's bytes with EINVAL and sends nothing.
+
+extern int     serial_transmit        (const char *buf, size_t count);
+extern int     serial_transmit_urgent (const char *buf, size_t count);
+
+// The back end takes ETX and any byte with the high bit set out of
+// band.
+static inline bool serial_is_urgent_char(char c)
+{
+    return c == '\003' || (c & 0x80);
+}
+extern ssize_t serial_receive         (      char *buf, size_t max);
+
+// Bytes the back end has acknowledged with flow control credit
+// since the port was opened.  serial_await_acknowledged() waits until
+// at least count bytes are.  It is a cancellation point.
+extern size_t  serial_acknowledged    (void);
+extern size_t  serial_await_acknowledged (size_t count);
+
+// Link statistics since the port was opened.  Credit waits are time
+// the bulk lane had data but no flow control credit, i.e., the back
+// end was not keeping up.  Output queue waits are time spent waiting
+// for the UART, i.e., the link was the bottleneck.
+
+#define SERIAL_BYTES_PER_SEC (115200 / 10)
+
+typedef struct serial_stats {
+    size_t   ss_tx_bytes;           // bulk bytes written
+    size_t   ss_urgent_bytes;       // control bytes written
+    size_t   ss_rx_raw_bytes;       // bytes read, flow control included
+    size_t   ss_rx_bytes;           // bytes read, flow control removed
+    unsigned ss_credit_waits;
+    double   ss_credit_wait_secs;
+    double   ss_credit_wait_max;
+    double   ss_outq_wait_secs;
+    double   ss_tx_secs;            // time spent in serial_transmit()
+    double   ss_open_secs;          // time since port opened
+} serial_stats;
+
+extern void    serial_get_stats       (serial_stats *);
 
 #endif /* !SERIAL_included */
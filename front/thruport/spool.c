@@ -0,0 +1,480 @@
+#include "spool.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "paths.h"
+#include "serial.h"
+
+// The spool file is a header followed by the job's data.  The whole
+// of SPOOL_MAX_SIZE is mapped once and the file grows under the
+// mapping, so pointers into it never move.  The header is in the
+// mapping too, so a job survives a daemon crash, and the next daemon
+// offers to resume it.
+//
+// Each job starts with a newline, which ends the back end's last line
+// if the job before was cancelled partway through a line.  Each job
+// ends with a wait command, so the back end finishes one job before
+// it starts the next.  The job's last bytes are padded with
+// newlines to a CREDIT_GRAIN boundary, so the back end's credit
+// covers the whole job, and the job stays in SPS_SENDING until it
+// does.
+//
+// The resume point is just after the last enqueue command ("Q...")
+// that the back end has read.  Credit can't find it: the back end
+// goes on reading what it had buffered after the port fails.  So
+// every job sets "sn=0" first, and when the port reopens, the send
+// thread ends any partial line the back end holds, turns on segment
+// number reports, and asks for a report (link_resync).  The number
+// tells how many enqueue commands the back end has executed, and a
+// job can't be resumed until it comes.  A job that sets sn itself
+// can only be resumed from the credit, and a segment may repeat.
+
+#define SPOOL_MAGIC       "TPSPOOL1"
+#define SPOOL_MAX_SIZE    ((size_t)256 << 20)
+#define SPOOL_GROW        ((size_t)1 << 20)
+#define SPOOL_DATA_OFFSET 64
+#define CREDIT_GRAIN      16
+
+static const char job_prologue[] = "\nsn=0\n";
+static const char job_epilogue[] = "W\n";   // let the back end drain
+static const char link_resync[]  = "\nrn=y\nR\n";
+
+typedef struct spool_header {
+    char     sh_magic[8];
+    uint32_t sh_state;          // spool_state
+    uint32_t sh_input_done;     // sender has sent EOF
+    uint64_t sh_length;         // bytes spooled
+    uint64_t sh_sent;           // bytes transmitted
+    uint64_t sh_acked;          // bytes read by the back end
+} spool_header;
+
+static pthread_mutex_t spool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  spool_cond = PTHREAD_COND_INITIALIZER;
+static spool_header   *header;
+static char           *data;
+static int             spool_fd = -1;
+static size_t          file_size;
+static size_t          link_base;    // link bytes sent before job's start
+static bool            job_cancelled;
+static bool            resync_pending;
+static bool            seg_fresh;    // segment report since resync
+static unsigned        seg_next;
+
+static void unlock(void *arg)
+{
+    pthread_mutex_unlock(arg);
+}
+
+static const char *get_spool_path(void)
+{
+    static char *path;
+    if (!path)
+        asprintf(&path, "%s/spool", get_socket_dir());
+    return path;
+}
+
+int init_spool(void)
+{
+    const char *path = get_spool_path();
+    spool_fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (spool_fd < 0) {
+        syslog(LOG_ERR, "%s: %m", path);
+        return -1;
+    }
+    struct stat s;
+    if (fstat(spool_fd, &s) < 0) {
+        syslog(LOG_ERR, "%s: fstat failed: %m", path);
+        return -1;
+    }
+    void *map = mmap(NULL, SPOOL_MAX_SIZE, PROT_READ | PROT_WRITE,
+                     MAP_SHARED, spool_fd, 0);
+    if (map == MAP_FAILED) {
+        syslog(LOG_ERR, "%s: mmap failed: %m", path);
+        return -1;
+    }
+    header = map;
+    data = (char *)map + SPOOL_DATA_OFFSET;
+    file_size = s.st_size;
+    if (file_size < SPOOL_DATA_OFFSET ||
+        memcmp(header->sh_magic, SPOOL_MAGIC, sizeof header->sh_magic) ||
+        header->sh_length > file_size - SPOOL_DATA_OFFSET ||
+        header->sh_sent > header->sh_length ||
+        header->sh_acked > header->sh_sent) {
+        if (ftruncate(spool_fd, SPOOL_DATA_OFFSET) < 0) {
+            syslog(LOG_ERR, "%s: ftruncate failed: %m", path);
+            return -1;
+        }
+        file_size = SPOOL_DATA_OFFSET;
+        memset(header, 0, sizeof *header);
+        memcpy(header->sh_magic, SPOOL_MAGIC, sizeof header->sh_magic);
+        header->sh_state = SPS_IDLE;
+    } else if (header->sh_state != SPS_IDLE) {
+        // A previous daemon died with a job in progress.
+        header->sh_state = SPS_INTERRUPTED;
+        resync_pending = true;
+        syslog(LOG_NOTICE, "spooled job found: %llu bytes",
+               (unsigned long long)header->sh_length);
+    }
+    return 0;
+}
+
+spool_state get_spool_state(void)
+{
+    pthread_mutex_lock(&spool_lock);
+    spool_state state = header->sh_state;
+    pthread_mutex_unlock(&spool_lock);
+    return state;
+}
+
+static int append_NOLOCK(const char *buf, size_t count)
+{
+    size_t end = SPOOL_DATA_OFFSET + header->sh_length + count;
+    if (end > SPOOL_MAX_SIZE) {
+        errno = EFBIG;
+        return -1;
+    }
+    if (end > file_size) {
+        size_t new_size = (end + SPOOL_GROW - 1) / SPOOL_GROW * SPOOL_GROW;
+        if (new_size > SPOOL_MAX_SIZE)
+            new_size = SPOOL_MAX_SIZE;
+        if (ftruncate(spool_fd, new_size) < 0)
+            return -1;
+        file_size = new_size;
+    }
+    memcpy(data + header->sh_length, buf, count);
+    header->sh_length += count;
+    pthread_cond_broadcast(&spool_cond);
+    return 0;
+}
+
+int spool_begin_job(void)
+{
+    int r = 0;
+    pthread_mutex_lock(&spool_lock);
+    if (header->sh_state != SPS_IDLE) {
+        errno = EBUSY;
+        r = -1;
+    } else {
+        header->sh_input_done = false;
+        header->sh_length = 0;
+        header->sh_sent = 0;
+        header->sh_acked = 0;
+        job_cancelled = false;
+        seg_fresh = false;
+        r = append_NOLOCK(job_prologue, sizeof job_prologue - 1);
+        if (r == 0)
+            header->sh_state = SPS_SENDING;
+    }
+    pthread_mutex_unlock(&spool_lock);
+    return r;
+}
+
+// Urgent bytes would run real-time commands when sent; see serial.h.
+static bool has_urgent_char(const char *buf, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        if (serial_is_urgent_char(buf[i]))
+            return true;
+    return false;
+}
+
+int spool_append(const char *buf, size_t count)
+{
+    int r;
+    pthread_mutex_lock(&spool_lock);
+    if (job_cancelled) {
+        errno = ECANCELED;
+        r = -1;
+    } else if (has_urgent_char(buf, count)) {
+        errno = EINVAL;
+        r = -1;
+    } else
+        r = append_NOLOCK(buf, count);
+    pthread_mutex_unlock(&spool_lock);
+    return r;
+}
+
+void spool_end_input(void)
+{
+    pthread_mutex_lock(&spool_lock);
+    if (!job_cancelled) {
+        if (header->sh_length && data[header->sh_length - 1] != '\n')
+            (void)append_NOLOCK("\n", 1);
+        (void)append_NOLOCK(job_epilogue, sizeof job_epilogue - 1);
+    }
+    header->sh_input_done = true;
+    pthread_cond_broadcast(&spool_cond);
+    pthread_mutex_unlock(&spool_lock);
+}
+
+bool spool_await_job(void)
+{
+    pthread_mutex_lock(&spool_lock);
+    while (header->sh_state != SPS_IDLE)
+        pthread_cond_wait(&spool_cond, &spool_lock);
+    bool done = !job_cancelled;
+    pthread_mutex_unlock(&spool_lock);
+    return done;
+}
+
+size_t spool_take(char *buf, size_t max, size_t link_sent)
+{
+    size_t count;
+    pthread_mutex_lock(&spool_lock);
+    pthread_cleanup_push(unlock, &spool_lock); {
+        while (!resync_pending &&
+               (header->sh_state != SPS_SENDING ||
+                (header->sh_sent == header->sh_length &&
+                 !header->sh_input_done)))
+            pthread_cond_wait(&spool_cond, &spool_lock);
+        if (resync_pending) {
+            count = sizeof link_resync - 1;
+            memcpy(buf, link_resync, count);
+            resync_pending = false;
+            seg_fresh = false;
+        } else {
+            link_base = link_sent - header->sh_sent;
+            count = header->sh_length - header->sh_sent;
+            if (count == 0) {
+                // Blank lines up to the next credit boundary.
+                count = -link_sent % CREDIT_GRAIN;
+                memset(buf, '\n', count);
+            } else {
+                if (count > max)
+                    count = max;
+                memcpy(buf, data + header->sh_sent, count);
+                header->sh_sent += count;
+            }
+        }
+    } pthread_cleanup_pop(1);
+    return count;
+}
+
+static void note_acked_NOLOCK(size_t link_acked)
+{
+    if (header->sh_state != SPS_SENDING ||
+        (ptrdiff_t)(link_acked - link_base) <= 0)
+        return;
+    size_t acked = link_acked - link_base;
+    if (acked > header->sh_sent)
+        acked = header->sh_sent;
+    if (acked > header->sh_acked)
+        header->sh_acked = acked;
+    if (header->sh_input_done && header->sh_acked == header->sh_length) {
+        header->sh_state = SPS_IDLE;
+        pthread_cond_broadcast(&spool_cond);
+    }
+}
+
+void spool_note_acked(size_t link_acked)
+{
+    pthread_mutex_lock(&spool_lock);
+    note_acked_NOLOCK(link_acked);
+    pthread_mutex_unlock(&spool_lock);
+}
+
+// Watch the decoded reports for segment numbers.
+void spool_scan_reports(const char *text, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        if ((i == 0 || text[i - 1] == '\n') && count - i > 4 &&
+            !memcmp(text + i, "N n=", 4)) {
+            unsigned n = 0;
+            size_t j;
+            for (j = i + 4; j < count && text[j] >= '0' && text[j] <= '9'; j++)
+                n = n * 10 + text[j] - '0';
+            if (j > i + 4) {
+                pthread_mutex_lock(&spool_lock);
+                seg_next = n;
+                seg_fresh = true;
+                pthread_mutex_unlock(&spool_lock);
+            }
+        }
+    }
+}
+
+bool spool_interrupt(size_t link_acked)
+{
+    bool interrupted = false;
+    pthread_mutex_lock(&spool_lock);
+    if (header->sh_state == SPS_SENDING)
+        note_acked_NOLOCK(link_acked);
+    if (header->sh_state == SPS_SENDING) {
+        header->sh_state = SPS_INTERRUPTED;
+        resync_pending = true;
+        seg_fresh = false;
+        interrupted = true;
+    }
+    pthread_mutex_unlock(&spool_lock);
+    return interrupted;
+}
+
+// Count the enqueue commands that end at or before limit.  Set
+// *end_out to the offset just after the last one.  Set *renumbered
+// if the job sets sn itself.
+static unsigned count_segments(size_t limit, size_t *end_out,
+                               bool *renumbered)
+{
+    unsigned n = 0;
+    size_t end = 0;
+    size_t pos = 0;
+    while (pos < limit) {
+        const char *nl = memchr(data + pos, '\n', limit - pos);
+        if (!nl)
+            break;
+        size_t next = nl - data + 1;
+        if (data[pos] == 'Q') {
+            n++;
+            end = next;
+        } else if (pos >= sizeof job_prologue - 1 && renumbered &&
+                   !strncmp(data + pos, "sn=", 3))
+            *renumbered = true;
+        pos = next;
+    }
+    if (end_out)
+        *end_out = end;
+    return n;
+}
+
+// Offset just after the n'th enqueue command.
+static size_t segment_end(unsigned n)
+{
+    size_t end = 0;
+    for (size_t pos = 0; n && pos < header->sh_length; ) {
+        const char *nl = memchr(data + pos, '\n', header->sh_length - pos);
+        if (!nl)
+            break;
+        size_t next = nl - data + 1;
+        if (data[pos] == 'Q' && --n == 0)
+            end = next;
+        pos = next;
+    }
+    return end;
+}
+
+// Find the resume point.  Returns -1 if the back end's segment
+// number shows that it has lost its place, e.g. it was reset, and 1
+// if the back end hasn't reported its segment number since the port
+// reopened.
+static int find_resume_point_NOLOCK(size_t *offset, bool *exact)
+{
+    size_t end;
+    bool renumbered = false;
+    unsigned total = count_segments(header->sh_sent, NULL, &renumbered);
+    unsigned lo = count_segments(header->sh_acked, &end, NULL);
+    if (renumbered) {
+        *offset = end;
+        *exact = false;
+        return 0;
+    }
+    if (!seg_fresh)
+        return 1;
+    // Segment numbers are 16 bits.
+    unsigned n = lo + ((seg_next - lo) & 0xFFFF);
+    if (n > total)
+        return -1;
+    *offset = segment_end(n);
+    *exact = true;
+    return 0;
+}
+
+int spool_resume(char *msg, size_t size)
+{
+    int r = -1;
+    pthread_mutex_lock(&spool_lock);
+    if (header->sh_state != SPS_INTERRUPTED)
+        snprintf(msg, size, "no interrupted job");
+    else {
+        size_t offset;
+        bool exact;
+        int found = find_resume_point_NOLOCK(&offset, &exact);
+        if (found < 0)
+            snprintf(msg, size, "back end has lost its place in the job "
+                     "(segment %u); cancel it", seg_next);
+        else if (found > 0)
+            snprintf(msg, size, "back end hasn't reported its place in "
+                     "the job yet; try again");
+        else {
+            syslog(LOG_NOTICE, "job resumed at byte %zu", offset);
+            header->sh_sent = offset;
+            header->sh_acked = offset;
+            header->sh_state = SPS_SENDING;
+            pthread_cond_broadcast(&spool_cond);
+            snprintf(msg, size, "resumed at byte %zu of %llu%s",
+                     offset, (unsigned long long)header->sh_length,
+                     exact ? "" : " (a segment may repeat)");
+            r = 0;
+        }
+    }
+    pthread_mutex_unlock(&spool_lock);
+    return r;
+}
+
+int spool_cancel(char *msg, size_t size)
+{
+    int r = -1;
+    pthread_mutex_lock(&spool_lock);
+    if (header->sh_state != SPS_IDLE) {
+        syslog(LOG_NOTICE, "job cancelled");
+        header->sh_state = SPS_IDLE;
+        job_cancelled = true;
+        pthread_cond_broadcast(&spool_cond);
+        r = 0;
+    }
+    pthread_mutex_unlock(&spool_lock);
+    if (msg)
+        snprintf(msg, size, r ? "no job" : "job cancelled");
+    return r;
+}
+
+void spool_describe(char *msg, size_t size)
+{
+    pthread_mutex_lock(&spool_lock);
+    unsigned long long length = header->sh_length;
+    unsigned long long sent = header->sh_sent;
+    unsigned long long acked = header->sh_acked;
+    const char *partial = header->sh_input_done ? "" : "+";
+    switch ((spool_state)header->sh_state) {
+
+    case SPS_IDLE:
+        snprintf(msg, size, "no job");
+        break;
+
+    case SPS_SENDING:
+        snprintf(msg, size, "sending: %llu of %llu%s bytes sent",
+                 sent, length, partial);
+        break;
+
+    case SPS_INTERRUPTED:
+        {
+            size_t offset;
+            bool exact;
+            int found = find_resume_point_NOLOCK(&offset, &exact);
+            if (found < 0)
+                snprintf(msg, size, "interrupted: %llu of %llu%s bytes "
+                         "acknowledged; back end has lost its place",
+                         acked, length, partial);
+            else if (found > 0)
+                snprintf(msg, size, "interrupted: %llu of %llu%s bytes "
+                         "acknowledged; awaiting the back end's report",
+                         acked, length, partial);
+            else
+                snprintf(msg, size, "interrupted: %llu of %llu%s bytes "
+                         "acknowledged; can resume at byte %zu%s",
+                         acked, length, partial, offset,
+                         exact ? "" : " (a segment may repeat)");
+        }
+        break;
+    }
+    pthread_mutex_unlock(&spool_lock);
+}
@@ -0,0 +1,48 @@
+#ifndef SPOOL_included
+#define SPOOL_included
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// The daemon spools each job to a memory-mapped file as the sender
+// sends it, and the send thread transmits from the spool.  If the
+// serial port fails partway through, the job stays in the spool, and
+// it can be resumed at a segment boundary once the port reopens.
+
+typedef enum spool_state {
+    SPS_IDLE,                   // no job
+    SPS_SENDING,                // job being transmitted
+    SPS_INTERRUPTED,            // awaiting resume-job or cancel-job
+} spool_state;
+
+extern int         init_spool          (void);
+extern spool_state get_spool_state     (void);
+
+// Sender side: spool_begin_job() fails with EBUSY unless the spool
+// is idle.  spool_await_job() waits until it is, and returns false if
+// the job was cancelled.  spool_append() fails with EINVAL if the data
+// holds a byte only the urgent lane may carry; see serial.h.
+extern int         spool_begin_job     (void);
+extern int         spool_append        (const char *data, size_t count);
+extern void        spool_end_input     (void);
+extern bool        spool_await_job     (void);
+
+// Transmit side: link_sent and link_acked count the bytes sent and
+// acknowledged by the back end since the serial port was opened.
+// spool_take() blocks until there is data to send, and returns 0 when
+// the whole job has been sent.  The job ends when spool_note_acked()
+// shows that the back end has read it all.  spool_take() is a
+// cancellation point.
+extern size_t      spool_take          (char *buf, size_t max,
+                                        size_t link_sent);
+extern void        spool_note_acked    (size_t link_acked);
+extern void        spool_scan_reports  (const char *data, size_t count);
+
+// Control: spool_interrupt() returns true if a job was interrupted.
+// The others fill msg with a one line description for the user.
+extern bool        spool_interrupt     (size_t link_acked);
+extern int         spool_resume        (char *msg, size_t size);
+extern int         spool_cancel        (char *msg, size_t size);
+extern void        spool_describe      (char *msg, size_t size);
+
+#endif /* !SPOOL_included */
@@ -0,0 +1,419 @@
+#!/usr/bin/python
+
+import argparse
+from collections import namedtuple
+import os
+import string
+import sys
+
+# gen-proto-defs [-t template] protocol.py > proto-defs.h
+# gen-proto-defs --python protocol.py > proto_defs.py
+
+
+disclaimer = '''
+    /*
+     *  This file was blah blah blah.
+     *
+     *     script:          %(script)s
+     *     protocol config: %(protocol)s
+     *     template:        %(template)s
+     */
+     '''.replace('blah blah blah', 'automatically generated from these inputs')
+
+default_template = '''
+    %AUTOGEN-DISCLAIMER%
+
+    %DEFINITIONS%
+'''
+
+python_disclaimer = '''
+    # This file was automatically generated from these inputs.
+    #
+    #    script:          %(script)s
+    #    protocol config: %(protocol)s
+'''
+
+python_module = '''
+    from collections import namedtuple
+
+    Command = namedtuple('Command', 'name action')
+    EnumValue = namedtuple('EnumValue', 'code name label')
+    Variable = namedtuple('Variable', 'name type values short_name full_name '
+                                      'observed report')
+    Fault = namedtuple('Fault', 'name description')
+
+    # Variable types are 'unsigned', 'signed' or 'enum'.  An enum
+    # variable's values are listed with the default first.
+'''
+
+script_path = sys.argv[0]
+script_file = os.path.basename(script_path)
+
+NOT_FOUND = 0xFF
+VF_OBSERVED = 1 << 0
+MAX_FAULTS = 16                 # bits in fault_word, back/fault.h
+
+Pair = namedtuple('Pair', 'name value')
+Command = namedtuple('Command', 'name action')
+Variable = namedtuple('Variable',
+                      'name type short_name full_name observed report')
+EnumValue = namedtuple('EnumValue', 'code name label')
+Fault = namedtuple('Fault', 'name description')
+
+class Blank(object):
+    pass
+
+
+# Type codes must match enum variable_type in back/variables.h.
+
+class VarType(object):
+
+    def __init__(self, name, code):
+        self.name = name
+        self.code = code
+        self.values = ()
+
+class Enum(VarType):
+
+    def __init__(self, *values):
+        super(Enum, self).__init__('enum', 005)
+        self.values = tuple(EnumValue(*v) for v in values)
+        codes = [v.code for v in self.values]
+        if not codes or len(set(codes)) != len(codes):
+            exit('%s: bad enumeration %r' % (script_file, codes))
+
+unsigned = VarType('unsigned', 026)
+signed = VarType('signed', 023)
+
+
+class Protocol(object):
+
+    def __init__(self):
+        self.commands = []
+        self.variables = []
+        self.faults = []
+
+    def def_command(self, name, action):
+        ok = (len(name) in (1, 2) and
+              name[0] in string.ascii_uppercase and
+              name[1:] in [''] + list(string.ascii_lowercase))
+        if not ok:
+            exit('%s: bad command name %r' % (script_file, name))
+        if name in (c.name for c in self.commands):
+            exit('%s: command %s defined twice' % (script_file, name))
+        self.commands.append(Command(name, action))
+
+    def def_variable(self, name, type, short_name, full_name,
+                     observed=False, report=None):
+        ok = (len(name) == 2 and
+              all(c in string.ascii_lowercase for c in name))
+        if not ok:
+            exit('%s: bad variable name %r' % (script_file, name))
+        if name in (v.name for v in self.variables):
+            exit('%s: variable %s defined twice' % (script_file, name))
+        if not isinstance(type, VarType):
+            exit('%s: variable %s has bad type' % (script_file, name))
+        self.variables.append(Variable(name, type, short_name, full_name,
+                                       observed, report))
+
+    def def_fault(self, name, description):
+        ok = (len(name) == 2 and
+              all(c in string.ascii_uppercase for c in name))
+        if not ok:
+            exit('%s: bad fault name %r' % (script_file, name))
+        if name in (f.name for f in self.faults):
+            exit('%s: fault %s defined twice' % (script_file, name))
+        if len(self.faults) == MAX_FAULTS:
+            exit('%s: too many faults' % script_file)
+        self.faults.append(Fault(name, description))
+
+
+def parse_protocol_config(protocol):
+    proto = Protocol()
+    env = {
+        'def_command': proto.def_command,
+        'def_enum': Enum,
+        'def_fault': proto.def_fault,
+        'def_variable': proto.def_variable,
+        'signed': signed,
+        'unsigned': unsigned,
+    }
+    exec protocol in env
+    return proto
+
+
+# A direct-index table is stored in two levels.  The first name
+# character selects a row; the second selects a column within the
+# row.  Row 0 is empty, and every unused first character maps to it,
+# so the table holds one row per first character actually in use.
+
+def two_level_table(keys, first_chars, second_chars):
+    rows = [[NOT_FOUND] * len(second_chars)]
+    row_map = [0] * len(first_chars)
+    for (index, (c0, c1)) in enumerate(keys):
+        r = first_chars.index(c0)
+        if not row_map[r]:
+            row_map[r] = len(rows)
+            rows.append([NOT_FOUND] * len(second_chars))
+        rows[row_map[r]][second_chars.index(c1)] = index
+    return row_map, rows
+
+def initializer(values, per_line=14):
+
+    def fmt(v):
+        return '0x%02x' % v if v == NOT_FOUND else '%4d' % v
+
+    def lines(values):
+        for i in range(0, len(values), per_line):
+            yield '    ' + ', '.join(fmt(v) for v in values[i:i+per_line])
+
+    return '{\n%s\n}' % ',\n'.join(lines(values))
+
+def table_initializer(rows):
+    rows = ('    ' + initializer(r).replace('\n', '\n    ') for r in rows)
+    return '{\n%s\n}' % ',\n'.join(rows)
+
+def command_defs(proto):
+    keys = [(c.name[0], c.name[1:]) for c in proto.commands]
+    row_map, rows = two_level_table(keys,
+                                    string.ascii_uppercase,
+                                    [''] + list(string.ascii_lowercase))
+    funcs = ',\n'.join('    action_%s' % c.action for c in proto.commands)
+    return [
+        Pair('COMMAND_COUNT', len(proto.commands)),
+        Pair('COMMAND_ROW_COUNT', len(rows)),
+        Pair('COMMAND_COL_COUNT', len(rows[0])),
+        Blank,
+        Pair('COMMAND_ROWS_INIT', initializer(row_map)),
+        Blank,
+        Pair('COMMAND_TABLE_INIT', table_initializer(rows)),
+        Blank,
+        Pair('COMMAND_FUNCTIONS_INIT', '{\n%s\n}' % funcs),
+        Blank,
+    ]
+
+def c_string(s):
+    return '"%s"' % ''.join(c if ' ' <= c <= '~' and c not in '"\\'
+                            else '\\%03o' % ord(c)
+                            for c in s)
+
+def variable_defs(proto):
+    names = ['V_%s' % v.name.upper() for v in proto.variables]
+    nw = max(len(n) for n in names) + 1
+    enumerators = '\n'.join('    %-*s /* %s */' % (nw, n + ',', v.full_name)
+                            for (n, v) in zip(names, proto.variables))
+    descs = ['%s=%s%s' % (v.name, chr(v.type.code),
+                          ''.join(e.code for e in v.type.values))
+             for v in proto.variables]
+    desc_size = max(len(d) for d in descs) + 1
+    desc_init = '{\n%s\n}' % ',\n'.join('    %s' % c_string(d)
+                                          for d in descs)
+    reports = [(n, v.report)
+               for (n, v) in zip(names, proto.variables)
+               if v.report]
+    report_init = '{\n%s\n}' % ',\n'.join('    { %s, report_%s }' % r
+                                            for r in reports)
+
+    keys = [(v.name[0], v.name[1]) for v in proto.variables]
+    row_map, rows = two_level_table(keys,
+                                    string.ascii_lowercase,
+                                    string.ascii_lowercase)
+    # Flag bits must match enum variable_flag in back/variables.h.
+    flags = [VF_OBSERVED if v.observed else 0 for v in proto.variables]
+    observed_mask = sum(1 << i
+                        for (i, v) in enumerate(proto.variables)
+                        if v.observed)
+    return [
+        Pair('VARIABLE_INDEX_ENUMERATORS', '\n' + enumerators),
+        Blank,
+        Pair('VAR_DESC_SIZE', desc_size),
+        Blank,
+        Pair('VARIABLE_DESCRIPTORS_INIT', desc_init),
+        Blank,
+        Pair('REPORT_DESCRIPTORS_INIT', report_init),
+        Blank,
+        Pair('VARIABLE_ROW_COUNT', len(rows)),
+        Pair('VARIABLE_COL_COUNT', len(rows[0])),
+        Blank,
+        Pair('VARIABLE_ROWS_INIT', initializer(row_map)),
+        Blank,
+        Pair('VARIABLE_TABLE_INIT', table_initializer(rows)),
+        Blank,
+        Pair('VARIABLE_FLAGS_INIT', initializer(flags)),
+        Blank,
+        Pair('OBSERVED_VARIABLES', '0x%08xUL' % observed_mask),
+        Blank,
+    ]
+
+def fault_defs(proto):
+    names = ['F_%s' % f.name for f in proto.faults]
+    nw = max(len(n) for n in names) + 1
+    enumerators = '\n'.join('    %-*s /* %s */' % (nw, n + ',', f.description)
+                            for (n, f) in zip(names, proto.faults))
+    name_init = '{\n%s\n}' % ',\n'.join('    %s' % c_string(f.name)
+                                          for f in proto.faults)
+    return [
+        Pair('FAULT_INDEX_ENUMERATORS', '\n' + enumerators),
+        Blank,
+        Pair('FAULT_NAME_SIZE', max(len(f.name) for f in proto.faults) + 1),
+        Blank,
+        Pair('FAULT_NAMES_INIT', name_init),
+        Blank,
+    ]
+
+def compile_defs(proto):
+    return command_defs(proto) + variable_defs(proto) + fault_defs(proto)
+
+
+def emit_python(proto, out, args):
+    print >>out, docstring_trim(sub_files(python_disclaimer, args))
+    print >>out
+    print >>out, docstring_trim(python_module)
+    print >>out
+    print >>out, 'commands = ('
+    for c in proto.commands:
+        print >>out, '    Command(%r, %r),' % (c.name, c.action)
+    print >>out, '    )'
+    print >>out
+    print >>out, 'variables = ('
+    for v in proto.variables:
+        print >>out, '    Variable(%r, %r,' % (v.name, v.type.name)
+        if v.type.values:
+            print >>out, '             ('
+            for e in v.type.values:
+                print >>out, '                 EnumValue%r,' % (tuple(e),)
+            print >>out, '             ),'
+        else:
+            print >>out, '             (),'
+        print >>out, '             %r, %r,' % (v.short_name, v.full_name)
+        print >>out, '             %r, %r),' % (v.observed, v.report)
+    print >>out, '    )'
+    print >>out
+    print >>out, 'faults = ('
+    for f in proto.faults:
+        print >>out, '    Fault(%r, %r),' % (f.name, f.description)
+    print >>out, '    )'
+
+
+def docstring_trim(docstring):
+
+    """Trim a docstring.  See PEP 257."""
+
+    if not docstring:
+        return ''
+    lines = docstring.expandtabs().splitlines()
+    trimmed = [lines.pop(0).strip()]
+    if lines:
+        indent = min(len(l) - len(l.lstrip()) for l in lines if l.lstrip())
+        trimmed.extend(line[indent:].rstrip() for line in lines)
+    while trimmed and not trimmed[-1]:
+        trimmed.pop()
+    while trimmed and not trimmed[0]:
+        trimmed.pop(0)
+    return '\n'.join(trimmed)
+
+def sub_files(s, args):
+    files = {
+        'script': script_path,
+        'protocol': args.protocol,
+        'template': args.template,
+        'output': args.output,
+    }
+    return s % files
+
+
+def emit_disclaimer(out, args):
+    print >>out, docstring_trim(sub_files(disclaimer, args))
+
+def emit_definitions(defs, out):
+    while defs and defs[-1] is Blank:
+        defs.pop()
+    while defs and defs[0] is Blank:
+        defs.pop(0)
+    w = max(len(n) for (n, v) in (d for d in defs if d is not Blank))
+    for d in defs:
+        if d is Blank:
+            print >>out
+            continue
+        n, v = d
+        v = str(v)
+        if '\n' in v:
+            # Multi-line initializer: continue each line with a backslash.
+            lines = ('#define %s %s' % (n, v)).splitlines()
+            lw = max(len(l) for l in lines)
+            for l in lines[:-1]:
+                print >>out, '%-*s \\' % (lw, l)
+            print >>out, lines[-1]
+        else:
+            print >>out, '#define %-*s %s' % (w, n, v)
+
+
+def expand(template, defs, out, args):
+    for line in template.splitlines():
+        if line == '%AUTOGEN-DISCLAIMER%':
+            emit_disclaimer(out, args)
+        elif line == '%DEFINITIONS%':
+            emit_definitions(defs, out)
+        else:
+            print >>out, line
+
+def gen_make_dependencies(args):
+    targets = args.MT
+    if not targets:
+        msg = '%s: ' % script_file
+        msg += 'Makefile dependency requires at least one -MT target'
+        exit(msg)
+    prereqs = [script_path, args.protocol]
+    if args.template:
+        prereqs.append(args.template)
+    out = get_output(args.output)
+    print >>out, '%s: %s' % (' '.join(targets), ' '.join(prereqs))
+
+
+def open_or_die(filename, mode='r'):
+    try:
+        return open(filename, mode)
+    except IOError as x:
+        exit('%s: %s' % (script_file, x))
+
+def get_template(template):
+    if template:
+        return open_or_die(template).read()
+    else:
+        return docstring_trim(default_template)
+
+def get_protocol(proto_file):
+    return open_or_die(proto_file)
+
+def get_output(out_file):
+    return open_or_die(out_file, 'w') if out_file else sys.stdout
+
+
+def main(argv):
+    desc = 'Generate protocol definitions from config.'
+    p = argparse.ArgumentParser(description=desc)
+    p.add_argument('-M', action='store_true',
+                   help='generate make dependencies')
+    p.add_argument('-MT', action='append', metavar='target',
+                   help='make rule target')
+    p.add_argument('-o', '--output', help='output file')
+    p.add_argument('-t', '--template', help='template file')
+    p.add_argument('--python', action='store_true',
+                   help='generate a Python module')
+    p.add_argument('protocol', help='protocol configuration file')
+    args = p.parse_args(argv[1:])
+
+    if args.M:
+        gen_make_dependencies(args)
+    else:
+        proto = parse_protocol_config(get_protocol(args.protocol))
+        output = get_output(args.output)
+        if args.python:
+            emit_python(proto, output, args)
+        else:
+            template = get_template(args.template)
+            defs = compile_defs(proto)
+            expand(template, defs, output, args)
+
+if __name__ == '__main__':
+    exit(main(sys.argv))